@@ -26,15 +26,21 @@
 
 #ifndef SIM3_CORE_H
 #define SIM3_CORE_H
+#include <string.h>
 #include "Types.h"
 #include "Instruction.h"
 #include "Register.h"
 #include "type_traits.h"
-
-template<typename T>
-inline volatile T& memory(const size_t address) noexcept {
-    return *reinterpret_cast<T*>(address);
-}
+#include "BusBackend.h"
+#include "DataCache.h"
+#include "StoreBuffer.h"
+#include "StackCache.h"
+#include "FrameStore.h"
+#include "InternalBootProgram.h"
+#ifdef HOST_JIT
+#include "X86BlockTranslator.h"
+#endif
+#include "InstructionProfiler.h"
 
 enum class FaultType : Ordinal {
     Trace = 0x0001'0000,
@@ -92,26 +98,111 @@ private:
     uint32_t field4_;
     uint32_t field5_;
 };
+/**
+ * @brief How many local register frames are kept on chip before calls start spilling to the stack; override with
+ * -DNUM_REGISTER_FRAMES=n (a power of two). Each one costs a 64 byte window plus a few bytes of bookkeeping so the mega2560 sticks to the four the real chip has.
+ */
+#ifndef NUM_REGISTER_FRAMES
+#ifdef DESKTOP_BUILD
+#define NUM_REGISTER_FRAMES 16
+#else
+#define NUM_REGISTER_FRAMES 4
+#endif
+#endif
 class Core {
 public:
-    static constexpr auto NumRegisterFrames = 4;
+    static constexpr Ordinal NumRegisterFrames = NUM_REGISTER_FRAMES;
+    static_assert(NumRegisterFrames >= 2 && (NumRegisterFrames & (NumRegisterFrames - 1)) == 0, "Register frame count must be a power of two");
+    static constexpr Ordinal RegisterFrameMask = NumRegisterFrames - 1;
     /**
-     * @brief The main node in a circular queue used to keep track of the on chip register entries
+     * @brief Dense index of every instruction the core knows about, generated from OpcodesRaw.h. This is what the decoder
+     * produces and what the dispatcher jumps on.
+     */
+    enum class DispatchIndex : byte {
+        Illegal = 0,
+#define X(value, name) name ,
+#include "OpcodesRaw.h"
+#undef X
+        Count,
+    };
+    static_assert(static_cast<size_t>(DispatchIndex::Count) <= 256, "Dispatch index must fit in a byte");
+    /**
+     * @brief Number of direct mapped entries in the decoded instruction cache and the basic block cache. Each decoded
+     * instruction costs roughly 25 bytes so keep these small on the mega2560
+     */
+#ifdef DESKTOP_BUILD
+    static constexpr size_t NumInstructionCacheEntries = 1024;
+    static constexpr size_t NumBlockCacheEntries = 256;
+    static constexpr size_t MaxBlockLength = 16;
+#else
+    static constexpr size_t NumInstructionCacheEntries = 16;
+    static constexpr size_t NumBlockCacheEntries = 4;
+    static constexpr size_t MaxBlockLength = 8;
+#endif
+    static_assert((NumInstructionCacheEntries & (NumInstructionCacheEntries - 1)) == 0, "Instruction cache entry count must be a power of two");
+    static_assert((NumBlockCacheEntries & (NumBlockCacheEntries - 1)) == 0, "Block cache entry count must be a power of two");
+    static_assert(MaxBlockLength <= 255, "Block length must fit in a byte");
+    /**
+     * @brief The main node in a circular queue used to keep track of the on chip register entries. The registers
+     * themselves live in a window of Core::registerFile_, a pack only records which window it owns and what is in it
      */
     class LocalRegisterPack {
     public:
         LocalRegisterPack() = default;
+        void bindWindow(RegisterFrame& window) noexcept { window_ = &window; }
+        [[nodiscard]] const RegisterFrame* getWindow() const noexcept { return window_; }
+        /**
+         * @brief Trade places with another pack, windows included, so handing a frame from one pack to another never
+         * copies registers
+         */
+        void exchange(LocalRegisterPack& other) noexcept {
+            auto temporary = *this;
+            *this = other;
+            other = temporary;
+        }
         [[nodiscard]] constexpr auto valid() const noexcept { return valid_; }
-        RegisterFrame& getUnderlyingFrame() noexcept { return underlyingFrame; }
-        [[nodiscard]] const RegisterFrame& getUnderlyingFrame() const noexcept { return underlyingFrame; }
+        [[nodiscard]] constexpr auto getFramePointerAddress() const noexcept { return framePointerAddress_; }
+#ifdef HOST_JIT
+        /**
+         * @brief Translated code checks its loads and stores against the stale frame by reading this directly; a pack
+         * which is not valid holds zero so it only costs the first 64 bytes of memory their fast path
+         */
+        [[nodiscard]] const Address* getFramePointerLocation() const noexcept { return &framePointerAddress_; }
+#endif
+        RegisterFrame& getUnderlyingFrame() noexcept { return *window_; }
+        [[nodiscard]] const RegisterFrame& getUnderlyingFrame() const noexcept { return *window_; }
+        /**
+         * @brief Record that the given registers have been written since the pack was filled or taken; only those are
+         * written back when the pack is spilled
+         */
+        void markDirty(uint16_t mask) noexcept { dirty_ |= mask; }
+        [[nodiscard]] constexpr auto getDirtyMask() const noexcept { return dirty_; }
+        /**
+         * @brief Quads of registers (bit 0 is r0-r3) of a restored frame which are still only on the stack, they are read
+         * in the first time a block which uses them runs. Tracking quads is how blocks ask for them and fits in a byte
+         */
+        [[nodiscard]] constexpr auto getUnloadedQuads() const noexcept { return unloadedQuads_; }
+        void markUnloaded(byte quads) noexcept { unloadedQuads_ |= quads; }
+        void markLoaded(byte quads) noexcept { unloadedQuads_ &= ~quads; }
+        [[nodiscard]] static constexpr uint16_t registersOf(byte quads) noexcept {
+            uint16_t mask = 0;
+            for (byte quad = 0; quad < 4; ++quad) {
+                if (quads & (1u << quad)) {
+                    mask |= 0b1111 << (quad * 4);
+                }
+            }
+            return mask;
+        }
         /**
          * @brief Relinquish ownership of the current register pack without saving the contents
          */
         void relinquishOwnership() noexcept {
             valid_ = false;
             framePointerAddress_ = 0;
+            dirty_ = 0;
+            unloadedQuads_ = 0;
             // the following code does something the original i960 spec does not do, clear registers out
-            //for (auto& a : underlyingFrame.gprs) {
+            //for (auto& a : window_->gprs) {
             //    a.setOrdinal(0);
             //}
         }
@@ -122,8 +213,8 @@ public:
          */
         template<typename T>
         void relinquishOwnership(T saveRegisters) noexcept {
-            if (valid_) {
-                saveRegisters(underlyingFrame, framePointerAddress_);
+            if (valid_ && dirty_ != 0) {
+                saveRegisters(*window_, framePointerAddress_, dirty_);
             }
             relinquishOwnership();
         }
@@ -135,14 +226,17 @@ public:
          */
         template<typename T>
         void takeOwnership(Address newFP, T saveRegisters) noexcept {
-            if (valid_) {
+            if (valid_ && dirty_ != 0) {
                 // we do not analyze to see if we got a match because that should never happen
-                saveRegisters(underlyingFrame, framePointerAddress_);
+                saveRegisters(*window_, framePointerAddress_, dirty_);
             }
             valid_ = true;
             framePointerAddress_ = newFP;
+            // the locals of a new frame are undefined until written so there is nothing to write back (or read) yet
+            dirty_ = 0;
+            unloadedQuads_ = 0;
             // don't clear out the registers
-            //for (auto& a : underlyingFrame.dprs) {
+            //for (auto& a : window_->dprs) {
             //    // clear out storage two registers at a time
             //    a.setLongOrdinal(0);
             //}
@@ -168,26 +262,138 @@ public:
                     return;
                 }
                 // okay we got a mismatch, the goal is to now save the current frame contents to memory
-                saveRegisters(underlyingFrame, framePointerAddress_);
+                if (dirty_ != 0) {
+                    saveRegisters(*window_, framePointerAddress_, dirty_);
+                }
                 // now we continue on as though this pack was initially invalid
             }
             // either is not valid
             // now do the restore operation since it doesn't matter how we got here
             valid_ = true;
             framePointerAddress_ = newFP;
-            restoreRegisters(underlyingFrame, framePointerAddress_);
+            dirty_ = 0;
+            unloadedQuads_ = 0;
+            restoreRegisters(*window_, framePointerAddress_);
         }
     private:
-        RegisterFrame underlyingFrame;
+        RegisterFrame* window_ = nullptr;
         Address framePointerAddress_ = 0;
+        uint16_t dirty_ = 0;
+        byte unloadedQuads_ = 0;
         bool valid_ = false;
     };
+    /**
+     * @brief An instruction which has already been fetched and decoded along with the handler it dispatches to
+     */
+    struct DecodedInstruction {
+        /**
+         * @brief Instructions are always word aligned so an odd address will never match a lookup
+         */
+        static constexpr Address InvalidAddress = 0xFFFF'FFFF;
+        Address address_ = InvalidAddress;
+        DispatchIndex dispatch_ = DispatchIndex::Illegal;
+        Instruction instruction_;
+    };
+    /**
+     * @brief A straight line run of decoded instructions which ends at a branch (or after MaxBlockLength instructions).
+     * The instructions are stored back to back so the addresses are implied by the start address and instruction lengths
+     */
+    struct DecodedBlock {
+        Address address_ = DecodedInstruction::InvalidAddress;
+        /**
+         * @brief The last byte fetched to build this block, used to check for overlapping stores
+         */
+        Address lastAddress_ = 0;
+        byte length_ = 0;
+        /**
+         * @brief Quads of locals any instruction in the block could read, a returned to frame only has these filled in
+         * before the block runs
+         */
+        byte quadsRead_ = 0;
+        DispatchIndex dispatch_[MaxBlockLength] = { DispatchIndex::Illegal };
+        Instruction instructions_[MaxBlockLength];
+#ifdef HOST_JIT
+        /**
+         * @brief How many times the interpreter has run this block, once it crosses JITThreshold the block is translated
+         */
+        Ordinal executions_ = 0;
+        X86BlockTranslator::Entry translated_ = nullptr;
+        /**
+         * @brief Locals the native code writes directly, they bypass getRegister so the dirty bits are applied afterwards
+         */
+        uint16_t localsWritten_ = 0;
+#endif
+    };
+#ifdef HOST_JIT
+    static constexpr Ordinal JITThreshold = 32;
+#endif
 public:
     explicit Core(Ordinal salign = 4);
     ~Core() = default;
     void begin() noexcept;
     void boot(Ordinal baseAddress = 0);
+    /**
+     * @brief Execute exactly one instruction, mostly useful for single stepping
+     */
     void cycle() noexcept;
+    /**
+     * @brief Execute whole basic blocks until at least the given number of instructions have been executed
+     * @param instructionBudget The number of instructions to execute before returning to the caller
+     * @return The number of instructions actually executed (the last block is always run to completion)
+     */
+    size_t run(size_t instructionBudget) noexcept;
+    /**
+     * @brief Direct access to the backing bus implementation; used by host drivers to install images before boot
+     */
+    BusBackend& getBus() noexcept { return bus_; }
+    const BusBackend& getBus() const noexcept { return bus_; }
+    /**
+     * @brief What the DMA device does with a block of guest memory
+     */
+    enum class BlockOperation : byte {
+        /**
+         * @brief Copy front to back, like memcpy the result is undefined if the two ranges overlap
+         */
+        Copy,
+        /**
+         * @brief Set every byte of the destination to the low byte of the source operand
+         */
+        Fill,
+        /**
+         * @brief Copy with memmove semantics, overlapping ranges are handled correctly
+         */
+        Move,
+    };
+    /**
+     * @brief Perform a bulk copy, fill or move natively; bus backed ranges are moved a block at a time and internal sram with
+     * memcpy, anything else (devices) falls back to byte transfers
+     */
+    void transferBlock(BlockOperation operation, Address destination, Address source, Ordinal length) noexcept;
+    /**
+     * @brief Raise an interrupt on behalf of a builtin device
+     */
+    void requestInterrupt(byte vector) noexcept { generateInterrupt(vector); }
+    /**
+     * @brief How many register frames have been written out to (or read back from) the stack because the on chip frames
+     * ran out; use these to pick NUM_REGISTER_FRAMES for a workload. A frame which is returned to counts as one fill no
+     * matter how many of its quads end up being read in.
+     */
+    [[nodiscard]] uint32_t getFrameSpills() const noexcept { return frameSpills_; }
+    [[nodiscard]] uint32_t getFrameFills() const noexcept { return frameFills_; }
+    void clearFrameStatistics() noexcept {
+        frameSpills_ = 0;
+        frameFills_ = 0;
+    }
+#ifdef PROFILE_INSTRUCTIONS
+    /**
+     * @brief Print the execution count (and time spent if PROFILE_INSTRUCTION_TIMING is defined) of every instruction
+     * which has executed since the last reset
+     */
+    void dumpInstructionProfile() noexcept;
+    using Profiler = InstructionProfiler<static_cast<size_t>(DispatchIndex::Count)>;
+    [[nodiscard]] const Profiler& getInstructionProfile() const noexcept { return profiler_; }
+    void clearInstructionProfile() noexcept { profiler_.clear(); }
+#endif
 private:
     [[nodiscard]] Ordinal getSystemAddressTableBase() const noexcept;
     [[nodiscard]] Ordinal getPRCBPtrBase() const noexcept;
@@ -209,38 +415,23 @@ private:
     template<typename T>
     typename TreatAs<T>::UnderlyingType load(Address destination, TreatAs<T>) noexcept {
         using K = TreatAs<T>;
+        writeBackStaleFrame(destination, sizeof(T));
         if (inInternalSpace(destination)) {
-            union {
-                byte bytes[sizeof(T)] ;
-                T value;
-            } container;
-            // okay we are in internal space. Do byte by byte transfers
-            for (size_t i = 0; i < sizeof(T); ++i, ++destination) {
-                container.bytes[i] = readFromInternalSpace(destination);
-            }
-            return container.value;
+            return loadFromInternalSpace(destination, K{});
         } else {
             // we are not in internal space so force the matter
-            setEBIUpper(destination);
             return loadFromBus(destination, K{});
         }
     }
     template<typename T>
     void store(Address destination, T value, TreatAs<T>) noexcept {
         using K = TreatAs<T>;
+            invalidateInstructionCache(destination, sizeof(T));
+            writeBackStaleFrame(destination, sizeof(T));
             if (inInternalSpace(destination)) {
-                union {
-                    byte bytes[sizeof(T)] ;
-                    T value;
-                } container;
-                container.value = value;
-                // okay we are in internal space. Do byte by byte transfers
-                for (size_t i = 0; i < sizeof(T); ++i, ++destination) {
-                    writeToInternalSpace(destination, container.bytes[i]);
-                }
+                storeToInternalSpace(destination, value, K{});
             } else {
                 // we are not in internal space so force the matter
-                setEBIUpper(destination);
                 storeToBus(destination, value, K{});
             }
     }
@@ -249,6 +440,7 @@ private:
     void storeByteInteger(Address destination, ByteInteger value) noexcept { store(destination, value, TreatAsByteInteger{}); }
     [[nodiscard]] inline LongOrdinal loadLong(Address destination) noexcept { return load(destination, TreatAsLongOrdinal{}); }
     [[nodiscard]] ByteOrdinal loadByte(Address destination) noexcept {
+        writeBackStaleFrame(destination, sizeof(ByteOrdinal));
         if (inInternalSpace(destination))  {
             return readFromInternalSpace(destination);
         } else {
@@ -256,6 +448,8 @@ private:
         }
     }
     void storeByte(Address destination, ByteOrdinal value) noexcept {
+        invalidateInstructionCache(destination, sizeof(ByteOrdinal));
+        writeBackStaleFrame(destination, sizeof(ByteOrdinal));
         if (inInternalSpace(destination)) {
             writeToInternalSpace(destination, value);
         } else {
@@ -271,59 +465,81 @@ private:
     template<typename T>
     [[nodiscard]] Operand<T> getOperand(RegisterIndex targetIndex) const noexcept {
         if constexpr (is_same_v<T, LongOrdinal>) {
-            if (isLocalRegister(targetIndex)) {
-                return Operand<T>{getLocals().getDoubleRegister(static_cast<uint8_t>(targetIndex))};
-            } else if (isGlobalRegister(targetIndex)) {
-                return Operand<T>{globals.getDoubleRegister(static_cast<uint8_t>(targetIndex))};
+            if (isRegister(targetIndex)) {
+                return Operand<T>{windowOf(targetIndex).getDoubleRegister(static_cast<uint8_t>(targetIndex))};
             } else if (isLiteral(targetIndex)) {
                 return Operand<T>{getLiteral(targetIndex, TreatAs<T>{})};
             } else {
                 return Operand<T>{};
             }
         } else if constexpr (is_same_v<T, TripleRegister>) {
-            if (isLocalRegister(targetIndex)) {
-                return Operand<T>{getLocals().getTripleRegister(static_cast<int>(targetIndex))};
-            } else if (isGlobalRegister(targetIndex)) {
-                return Operand<T>{globals.getTripleRegister(static_cast<int>(targetIndex))};
+            if (isRegister(targetIndex)) {
+                return Operand<T>{windowOf(targetIndex).getTripleRegister(static_cast<int>(targetIndex))};
             } else if (isLiteral(targetIndex)) {
                 return Operand<T>{getLiteral(targetIndex, TreatAs<T>{})};
             } else {
                 return Operand<T>();
             }
         } else if constexpr (is_same_v<T, QuadRegister>) {
-            if (isLocalRegister(targetIndex)) {
-                return Operand<T>(getLocals().getQuadRegister(static_cast<int>(targetIndex)));
-            } else if (isGlobalRegister(targetIndex)) {
-                return Operand<T>(globals.getQuadRegister(static_cast<int>(targetIndex)));
+            if (isRegister(targetIndex)) {
+                return Operand<T>(windowOf(targetIndex).getQuadRegister(static_cast<int>(targetIndex)));
             } else if (isLiteral(targetIndex)) {
                 return Operand<T>{getLiteral(targetIndex, TreatAs<T>{})};
             } else {
                 return Operand<T>();
             }
         } else {
-            if (isLocalRegister(targetIndex)) {
-                return Operand<T>{getLocals().getRegister(static_cast<uint8_t>(targetIndex))};
-            } else if (isGlobalRegister(targetIndex)) {
-                return Operand<T>{globals.getRegister(static_cast<uint8_t>(targetIndex))};
-            } else if (isLiteral(targetIndex)) {
-                return Operand<T>{getLiteral(targetIndex, TreatAs<T>{})};
-            } else {
-                return Operand<T>{};
-            }
+            return Operand<T>{operandRegister(targetIndex)};
         }
     }
+    /**
+     * @brief Position of a register or literal in registerFile_, a single add of the current window base for locals or
+     * of the fixed base the globals (and the literals after them) sit at for everything else. RegisterIndex::Bad (an
+     * operand field the instruction does not use) lands on ZeroRegister.
+     */
+    [[nodiscard]] Ordinal fileIndexOf(RegisterIndex targetIndex) const noexcept {
+        // select the base with a mask, operands mix locals and globals too freely for a branch to predict well
+        auto localMask = static_cast<Ordinal>(0) - static_cast<Ordinal>(isLocalRegister(targetIndex));
+        auto index = static_cast<Ordinal>(static_cast<byte>(targetIndex));
+        // Bad is the only index with the top bit set, the xor turns its 127 into 64
+        auto position = (index & 0b111'1111) ^ ((index >> 7) * 0b11'1111);
+        return position + (GlobalsBase ^ ((localsBase_ ^ GlobalsBase) & localMask));
+    }
+    [[nodiscard]] RegisterFrame& windowOf(RegisterIndex targetIndex) noexcept { return registerFile_.windows[fileIndexOf(targetIndex) / 16]; }
+    [[nodiscard]] const RegisterFrame& windowOf(RegisterIndex targetIndex) const noexcept { return registerFile_.windows[fileIndexOf(targetIndex) / 16]; }
+    /**
+     * @brief Branch free lookup of a source operand, literals are read out of the register file so they look like any other register
+     */
+    [[nodiscard]] const Register& operandRegister(RegisterIndex targetIndex) const noexcept {
+        return registerFile_.registers[fileIndexOf(targetIndex)];
+    }
+    /**
+     * @brief Point the locals base at the window of the current pack, must be called whenever currentFrameIndex_ changes
+     * or the current pack trades windows
+     */
+    void rebindLocals() noexcept { localsBase_ = (getCurrentPack().getWindow() - registerFile_.windows) * 16; }
+    /**
+     * @brief Registers which are about to be written, any locals handed out are marked dirty so they get spilled
+     */
     [[nodiscard]] Register& getRegister(RegisterIndex targetIndex);
     [[nodiscard]] DoubleRegister& getDoubleRegister(RegisterIndex targetIndex);
     [[nodiscard]] TripleRegister& getTripleRegister(RegisterIndex targetIndex);
     [[nodiscard]] QuadRegister& getQuadRegister(RegisterIndex targetIndex);
-    [[nodiscard]] inline const TripleRegister& sourceFromSrcDest(const Instruction& inst, TreatAsTripleRegister) noexcept { return getTripleRegister(inst.getSrcDest(true)); }
-    [[nodiscard]] inline const QuadRegister& sourceFromSrcDest(const Instruction& inst, TreatAsQuadRegister) noexcept { return getQuadRegister(inst.getSrcDest(true)); }
+    /**
+     * @brief Registers which are only read, nothing is marked dirty
+     */
+    [[nodiscard]] const Register& getSourceRegister(RegisterIndex targetIndex);
+    [[nodiscard]] const TripleRegister& getSourceTripleRegister(RegisterIndex targetIndex);
+    [[nodiscard]] const QuadRegister& getSourceQuadRegister(RegisterIndex targetIndex);
+    [[nodiscard]] inline const TripleRegister& sourceFromSrcDest(const Instruction& inst, TreatAsTripleRegister) noexcept { return getSourceTripleRegister(inst.getSrcDest(true)); }
+    [[nodiscard]] inline const QuadRegister& sourceFromSrcDest(const Instruction& inst, TreatAsQuadRegister) noexcept { return getSourceQuadRegister(inst.getSrcDest(true)); }
     [[nodiscard]] inline TripleRegister& destinationFromSrcDest(const Instruction& inst, TreatAsTripleRegister) noexcept { return getTripleRegister(inst.getSrcDest(false)); }
     [[nodiscard]] inline QuadRegister& destinationFromSrcDest(const Instruction& inst, TreatAsQuadRegister) noexcept { return getQuadRegister(inst.getSrcDest(false)); }
     [[nodiscard]] Register& getStackPointer() noexcept { return getRegister(RegisterIndex::SP960); }
     [[nodiscard]] FramePointer getFramePointer() noexcept { return FramePointer(getRegister(RegisterIndex::FP), frameAlignmentMask_); }
-    [[nodiscard]] PreviousFramePointer getPFP() noexcept { return PreviousFramePointer(getRegister(RegisterIndex::PFP)); }
-    [[nodiscard]] Register& getRIP() noexcept { return getRegister(RegisterIndex::RIP); }
+    [[nodiscard]] PreviousFramePointer getPFP() noexcept { return PreviousFramePointer(getSourceRegister(RegisterIndex::PFP)); }
+    [[nodiscard]] PreviousFramePointer getWritablePFP() noexcept { return PreviousFramePointer(getRegister(RegisterIndex::PFP)); }
+    [[nodiscard]] const Register& getRIP() noexcept { return getSourceRegister(RegisterIndex::RIP); }
 private:
     /**
      * @brief Compute the next instruction location and store it in RIP
@@ -337,7 +553,61 @@ private:
     void flushreg(const Instruction&) noexcept;
     void ipRelativeBranch(const Instruction& inst) noexcept;
     [[nodiscard]] Instruction loadInstruction(Address baseAddress) noexcept;
-    void executeInstruction(const Instruction& instruction) noexcept;
+    [[nodiscard]] Ordinal fetchInstructionWord(Address address) noexcept;
+    [[nodiscard]] static DispatchIndex decodeDispatchIndex(const Instruction& instruction) noexcept;
+    void executeInstruction(DispatchIndex index, const Instruction& instruction) noexcept {
+#ifdef PROFILE_INSTRUCTIONS
+        auto start = Profiler::now();
+        dispatchInstruction(index, instruction);
+        profiler_.record(static_cast<size_t>(index), start);
+#else
+        dispatchInstruction(index, instruction);
+#endif
+    }
+    void dispatchInstruction(DispatchIndex index, const Instruction& instruction) noexcept;
+    /**
+     * @brief Get the decoded form of the instruction at the given address, only going out to memory on a cache miss
+     * @param address The address of the instruction
+     * @return The cache entry holding the decoded instruction
+     */
+    [[nodiscard]] const DecodedInstruction& fetchDecodedInstruction(Address address) noexcept;
+    /**
+     * @brief Get the basic block starting at the given address, discovering and decoding it on a miss
+     * @param address The address of the first instruction in the block
+     * @return The cache entry holding the block
+     */
+    [[nodiscard]] DecodedBlock& fetchDecodedBlock(Address address) noexcept;
+    /**
+     * @brief Does the given instruction end a basic block; true for anything that can transfer control
+     */
+    [[nodiscard]] static bool endsBasicBlock(DispatchIndex index) noexcept;
+    /**
+     * @brief Throw out any decoded instructions overlapping the given byte range, called on every store
+     * @param destination The first byte written
+     * @param count The number of bytes written
+     */
+    inline void invalidateInstructionCache(Address destination, size_t count) noexcept {
+        // most stores are to the stack or data, so only walk the cache if the store lands in the range of decoded code
+        if (destination <= instructionCacheHighest_ && (destination + (count - 1)) >= instructionCacheLowest_) {
+            invalidateInstructionCacheRange(destination, count);
+        }
+    }
+    void invalidateInstructionCacheRange(Address destination, size_t count) noexcept;
+    void purgeInstructionCache() noexcept;
+#ifdef HOST_JIT
+    /**
+     * @brief Generate native code for the given block; register to register arithmetic and lda are done inline, loads
+     * and stores go straight to host ram when their address is plain ram, and everything else calls back into the
+     * interpreter through jitFallback. Blocks where most of the instructions would call back are left to the interpreter.
+     */
+    void translateBlock(DecodedBlock& block) noexcept;
+    /**
+     * @brief Execute a single instruction on behalf of a translated block
+     * @return true if the translated block can keep going, false if control left the block (branch, fault, frame change,
+     * or the block itself was overwritten)
+     */
+    static bool jitFallback(void* core, const void* instruction, Ordinal dispatch, Address address, void* block, Address blockAddress) noexcept;
+#endif
     template<typename T>
     static constexpr byte compareGeneric(T src1, T src2) noexcept {
         if (src1 < src2) {
@@ -375,7 +645,10 @@ private:
     inline void cmpinco(const Instruction& inst) noexcept { cmpincx(inst, TreatAsOrdinal{}); }
     inline void cmpinci(const Instruction& inst) noexcept { cmpincx(inst, TreatAsInteger{}); }
     void syncf() noexcept;
-    void syncf(const Instruction&) noexcept { syncf(); }
+    void syncf(const Instruction&) noexcept {
+        writeBackDataCache();
+        syncf();
+    }
     void cmpobx(const Instruction& instruction, uint8_t mask) noexcept;
     void cmpobx(const Instruction& instruction) noexcept { cmpobx(instruction, instruction.getEmbeddedMask()); }
     void cmpibx(const Instruction& instruction, uint8_t mask) noexcept;
@@ -419,8 +692,75 @@ private:
         return sourceFromSrcDest<T>(instruction).getValue();
     }
 private:
-    void saveRegisterFrame(const RegisterFrame& theFrame, Address baseAddress) noexcept;
-    void restoreRegisterFrame(RegisterFrame& theFrame, Address baseAddress) noexcept;
+    /**
+     * @brief Write a register frame back to the stack
+     * @param dirtyMask Which of the 16 registers need to be written, everything else is already in memory
+     */
+    void saveRegisterFrame(const RegisterFrame& theFrame, Address baseAddress, uint16_t dirtyMask = 0xFFFF) noexcept;
+    /**
+     * @brief Read registers back from the stack
+     * @param mask Which of the 16 registers to read
+     */
+    void restoreRegisterFrame(RegisterFrame& theFrame, Address baseAddress, uint16_t mask = 0xFFFF) noexcept;
+    static constexpr byte AllQuads = 0b1111;
+    /**
+     * @brief Read in whichever of the given quads of a partially restored pack are still on the stack; registers written
+     * since the restore are newer than the stack copy and are left alone
+     */
+    void fillRegisters(LocalRegisterPack& pack, byte quads) noexcept {
+        if (auto missing = pack.getUnloadedQuads() & quads; missing != 0) {
+            if (auto registers = LocalRegisterPack::registersOf(missing) & ~pack.getDirtyMask(); registers != 0) {
+                restoreRegisterFrame(pack.getUnderlyingFrame(), pack.getFramePointerAddress(), registers);
+            }
+            pack.markLoaded(missing);
+        }
+    }
+    /**
+     * @brief Conservative set of local quads an instruction touches, every register field it has (used or not) is counted
+     * and whole quads cover the long operands
+     */
+    [[nodiscard]] static constexpr byte quadsReferencedBy(const Instruction& instruction) noexcept {
+        const RegisterIndex fields[] { instruction.getSrc1(), instruction.getSrc2(), instruction.getSrcDest(true), instruction.getSrcDest(false),
+                                       instruction.getABase(), instruction.getIndex() };
+        byte quads = 0;
+        for (auto index : fields) {
+            if (isLocalRegister(index)) {
+                quads |= 1u << ((static_cast<byte>(index) >> 2) & 0b11);
+            }
+        }
+        return quads;
+    }
+    /**
+     * @brief Move a pack which is about to be reused into staleFrame_ instead of spilling it; whatever was stale before is
+     * written back (or pushed into the frame store) to make room
+     */
+    void retireFrame(LocalRegisterPack& pack) noexcept;
+    /**
+     * @brief Spill the stale frame (if it is dirty) and forget it
+     */
+    void writeBackStaleFrame() noexcept;
+    /**
+     * @brief Spill the stale frame, and any frame store entries, only if the given range touches their 64 bytes of
+     * stack; guest accesses to a frame which has been evicted must see the registers as if they had been written out
+     * straight away
+     */
+    void writeBackStaleFrame(Address destination, size_t count) noexcept {
+        if (staleFrame_.valid()) {
+            auto base = staleFrame_.getFramePointerAddress();
+            if ((destination - base) < RegisterFrame::Size || (base - destination) < count) {
+                writeBackStaleFrame();
+            }
+        }
+#ifdef FRAME_STORE
+        frameStore_.writeBack(destination, count, [this](const RegisterFrame& frame, Address address, uint16_t dirtyMask) noexcept { saveRegisterFrame(frame, address, dirtyMask); });
+#endif
+    }
+#ifdef FRAME_STORE
+    /**
+     * @brief Push the stale frame down into the frame store and forget it
+     */
+    void stashStaleFrame() noexcept;
+#endif
     Ordinal computeMemoryAddress(const Instruction& instruction) noexcept;
 private:
     /**
@@ -692,6 +1032,94 @@ private:
 private: // extended instructions
     void bswap(const Instruction& inst) noexcept;
     void condSelect(const Instruction& inst) noexcept;
+private: // opcode names, every entry in OpcodesRaw.h must name a member so the dispatcher can be generated from that list
+    inline void bno(const Instruction& inst) noexcept { condBranch(inst); }
+    inline void bg(const Instruction& inst) noexcept { condBranch(inst); }
+    inline void be(const Instruction& inst) noexcept { condBranch(inst); }
+    inline void bge(const Instruction& inst) noexcept { condBranch(inst); }
+    inline void bl(const Instruction& inst) noexcept { condBranch(inst); }
+    inline void bne(const Instruction& inst) noexcept { condBranch(inst); }
+    inline void ble(const Instruction& inst) noexcept { condBranch(inst); }
+    inline void bo(const Instruction& inst) noexcept { condBranch(inst); }
+    inline void faultno(const Instruction& inst) noexcept { condFault(inst); }
+    inline void faultg(const Instruction& inst) noexcept { condFault(inst); }
+    inline void faulte(const Instruction& inst) noexcept { condFault(inst); }
+    inline void faultge(const Instruction& inst) noexcept { condFault(inst); }
+    inline void faultl(const Instruction& inst) noexcept { condFault(inst); }
+    inline void faultne(const Instruction& inst) noexcept { condFault(inst); }
+    inline void faultle(const Instruction& inst) noexcept { condFault(inst); }
+    inline void faulto(const Instruction& inst) noexcept { condFault(inst); }
+    inline void testno(const Instruction& inst) noexcept { testOp(inst); }
+    inline void testg(const Instruction& inst) noexcept { testOp(inst); }
+    inline void teste(const Instruction& inst) noexcept { testOp(inst); }
+    inline void testge(const Instruction& inst) noexcept { testOp(inst); }
+    inline void testl(const Instruction& inst) noexcept { testOp(inst); }
+    inline void testne(const Instruction& inst) noexcept { testOp(inst); }
+    inline void testle(const Instruction& inst) noexcept { testOp(inst); }
+    inline void testo(const Instruction& inst) noexcept { testOp(inst); }
+    inline void cmpobg(const Instruction& inst) noexcept { cmpobx(inst); }
+    inline void cmpobe(const Instruction& inst) noexcept { cmpobx(inst); }
+    inline void cmpobge(const Instruction& inst) noexcept { cmpobx(inst); }
+    inline void cmpobl(const Instruction& inst) noexcept { cmpobx(inst); }
+    inline void cmpobne(const Instruction& inst) noexcept { cmpobx(inst); }
+    inline void cmpoble(const Instruction& inst) noexcept { cmpobx(inst); }
+    inline void cmpibno(const Instruction& inst) noexcept { cmpibx(inst); }
+    inline void cmpibg(const Instruction& inst) noexcept { cmpibx(inst); }
+    inline void cmpibe(const Instruction& inst) noexcept { cmpibx(inst); }
+    inline void cmpibge(const Instruction& inst) noexcept { cmpibx(inst); }
+    inline void cmpibl(const Instruction& inst) noexcept { cmpibx(inst); }
+    inline void cmpibne(const Instruction& inst) noexcept { cmpibx(inst); }
+    inline void cmpible(const Instruction& inst) noexcept { cmpibx(inst); }
+    inline void cmpibo(const Instruction& inst) noexcept { cmpibx(inst); }
+    inline void logicalAnd(const Instruction& inst) noexcept { logicalOpGeneric<LogicalOp::And>(inst); }
+    inline void andnot(const Instruction& inst) noexcept { logicalOpGeneric<LogicalOp::AndNot>(inst); }
+    inline void notand(const Instruction& inst) noexcept { logicalOpGeneric<LogicalOp::NotAnd>(inst); }
+    inline void logicalXor(const Instruction& inst) noexcept { logicalOpGeneric<LogicalOp::Xor>(inst); }
+    inline void logicalOr(const Instruction& inst) noexcept { logicalOpGeneric<LogicalOp::Or>(inst); }
+    inline void logicalNor(const Instruction& inst) noexcept { logicalOpGeneric<LogicalOp::Nor>(inst); }
+    inline void logicalXnor(const Instruction& inst) noexcept { logicalOpGeneric<LogicalOp::Xnor>(inst); }
+    inline void logicalNot(const Instruction& inst) noexcept { logicalOpGeneric<LogicalOp::Not>(inst); }
+    inline void ornot(const Instruction& inst) noexcept { logicalOpGeneric<LogicalOp::OrNot>(inst); }
+    inline void notor(const Instruction& inst) noexcept { logicalOpGeneric<LogicalOp::NotOr>(inst); }
+    inline void logicalNand(const Instruction& inst) noexcept { logicalOpGeneric<LogicalOp::Nand>(inst); }
+    inline void addo(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::Add, Ordinal>(inst); }
+    inline void addi(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::Add, Integer>(inst); }
+    inline void subo(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::Subtract, Ordinal>(inst); }
+    inline void subi(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::Subtract, Integer>(inst); }
+    inline void shri(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::ShiftRight, Integer>(inst); }
+    inline void rotate(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::Rotate, Ordinal>(inst); }
+    inline void shli(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::ShiftLeft, Integer>(inst); }
+    inline void concmpo(const Instruction& inst) noexcept { concmpGeneric<Ordinal>(inst); }
+    inline void concmpi(const Instruction& inst) noexcept { concmpGeneric<Integer>(inst); }
+    inline void mulo(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::Multiply, Ordinal>(inst); }
+    inline void remo(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::Remainder, Ordinal>(inst); }
+    inline void divo(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::Divide, Ordinal>(inst); }
+    inline void muli(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::Multiply, Integer>(inst); }
+    inline void remi(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::Remainder, Integer>(inst); }
+    inline void divi(const Instruction& inst) noexcept { arithmeticGeneric<ArithmeticOperation::Divide, Integer>(inst); }
+#define Unimplemented(name) inline void name(const Instruction& inst) noexcept { illegalInstruction(inst); }
+#define Select(name) inline void name(const Instruction& inst) noexcept { condSelect(inst); }
+#ifdef CORE_ARCHITECTURE_EXTENSIONS
+    /// @todo implement the extended compare, interrupt, and conditional add/subtract instructions
+    Unimplemented(cmpob) Unimplemented(cmpib) Unimplemented(cmpos) Unimplemented(cmpis)
+    Unimplemented(intdis) Unimplemented(inten) Unimplemented(eshro)
+    Unimplemented(addono) Unimplemented(addino) Unimplemented(subono) Unimplemented(subino) Select(selno)
+    Unimplemented(addog) Unimplemented(addig) Unimplemented(subog) Unimplemented(subig) Select(selg)
+    Unimplemented(addoe) Unimplemented(addie) Unimplemented(suboe) Unimplemented(subie) Select(sele)
+    Unimplemented(addoge) Unimplemented(addige) Unimplemented(suboge) Unimplemented(subige) Select(selge)
+    Unimplemented(addol) Unimplemented(addil) Unimplemented(subol) Unimplemented(subil) Select(sell)
+    Unimplemented(addone) Unimplemented(addine) Unimplemented(subone) Unimplemented(subine) Select(selne)
+    Unimplemented(addole) Unimplemented(addile) Unimplemented(subole) Unimplemented(subile) Select(selle)
+    Unimplemented(addoo) Unimplemented(addio) Unimplemented(suboo) Unimplemented(subio) Select(selo)
+#endif
+#ifdef NUMERICS_ARCHITECTURE
+    Unimplemented(daddc) Unimplemented(dsubc) Unimplemented(dmovt)
+#endif
+#ifdef CORE_ARCHITECTURE_EXTENSIONS_JX_SPECIFIC
+    Unimplemented(intctl) Unimplemented(sysctl) Unimplemented(icctl) Unimplemented(dcctl) Unimplemented(halt)
+#endif
+#undef Select
+#undef Unimplemented
 private:
     void handleFaultReturn() noexcept;
     void handleSupervisorReturnWithTraceSet() noexcept;
@@ -718,29 +1146,168 @@ private:
     void ldis(const Instruction& inst) noexcept;
     void stis(const Instruction& inst) noexcept;
 private: // implementation specific
-    void setEBIUpper(Address address) noexcept;
     [[nodiscard]] static constexpr bool inInternalSpace(Address destination) noexcept {
         return static_cast<byte>(destination >> 24) == 0xFF;
     }
     /**
-     * @brief Compute the actual address within the EBI window
-     * @param offset The lower 16-bits of the address
-     * @return The adjusted window address
+     * @brief The different kinds of memory found in internal space, everything which is not explicitly mapped goes out
+     * over the bus
      */
-    [[nodiscard]] static constexpr size_t computeWindowOffsetAddress(Address offset) noexcept {
-        return 0x8000 + (static_cast<size_t>(offset) & 0x7FFF);
-    }
+    enum class InternalRegion : byte {
+        BootProgram,
+        SRAM,
+        Peripherals,
+        ConfigurationSpace,
+        Bus,
+    };
+    [[nodiscard]] static constexpr InternalRegion classifyInternalAddress(Address destination) noexcept;
+    /**
+     * @brief Which region an access falls in, the peripheral handlers are used for anything which crosses regions since
+     * they go a byte at a time
+     */
+    [[nodiscard]] static constexpr InternalRegion classifyInternalAccess(Address destination, size_t count) noexcept;
     [[nodiscard]] ByteOrdinal readFromInternalSpace(Address destination) noexcept;
     void writeToInternalSpace(Address destination, byte value) noexcept;
+    /**
+     * @brief Move a block in or out of guest memory in as few transactions as possible: one bus (or data cache) transfer,
+     * one memcpy for internal sram, and a byte at a time only for device registers and ranges which straddle regions
+     */
+    inline void readBlock(Address source, byte* buffer, size_t count) noexcept;
+    inline void writeBlock(Address destination, const byte* buffer, size_t count) noexcept;
+    template<typename T>
+    typename TreatAs<T>::UnderlyingType loadFromInternalSpace(Address destination, TreatAs<T>) noexcept;
+    template<typename T>
+    void storeToInternalSpace(Address destination, T value, TreatAs<T>) noexcept;
     template<typename T>
     void storeToBus(Address destination, T value, TreatAs<T>) noexcept {
-        setEBIUpper(destination);
-        memory<T>(computeWindowOffsetAddress(destination)) = value;
+#ifdef DATA_CACHE
+        dataCache_.store(bus_, destination, value);
+#elif defined(STORE_BUFFER)
+        storeBuffer_.store(bus_, destination, value);
+#elif defined(STACK_CACHE)
+        stackCache_.store(bus_, destination, value);
+#else
+        bus_.store(destination, value, TreatAs<T>{});
+#endif
     }
     template<typename T>
     typename TreatAs<T>::UnderlyingType loadFromBus(Address destination, TreatAs<T>) noexcept {
-        setEBIUpper(destination);
-        return memory<T>(computeWindowOffsetAddress(destination));
+#ifdef DATA_CACHE
+        return dataCache_.load<T>(bus_, destination);
+#elif defined(STORE_BUFFER)
+        return storeBuffer_.load<T>(bus_, destination);
+#elif defined(STACK_CACHE)
+        return stackCache_.load<T>(bus_, destination);
+#else
+        return bus_.load(destination, TreatAs<T>{});
+#endif
+    }
+    void loadBlockFromBus(Address source, byte* buffer, size_t count) noexcept {
+#ifdef DATA_CACHE
+        dataCache_.loadBlock(bus_, source, buffer, count);
+#elif defined(STORE_BUFFER)
+        storeBuffer_.loadBlock(bus_, source, buffer, count);
+#elif defined(STACK_CACHE)
+        stackCache_.loadBlock(bus_, source, buffer, count);
+#else
+        bus_.loadBlock(source, buffer, count);
+#endif
+    }
+    void storeBlockToBus(Address destination, const byte* buffer, size_t count) noexcept {
+#ifdef DATA_CACHE
+        dataCache_.storeBlock(bus_, destination, buffer, count);
+#elif defined(STORE_BUFFER)
+        storeBuffer_.storeBlock(bus_, destination, buffer, count);
+#elif defined(STACK_CACHE)
+        stackCache_.storeBlock(bus_, destination, buffer, count);
+#else
+        bus_.storeBlock(destination, buffer, count);
+#endif
+    }
+    /**
+     * @brief Move part of a register frame to or from its stack slot. With the data cache (or store buffer) the frame is
+     * flushed out of it first and the bus is used directly; frames are exactly the traffic the stack cache is for so
+     * with it they go through the cache instead
+     */
+    void prepareFrameTransfer([[maybe_unused]] Address baseAddress) noexcept {
+#ifndef STACK_CACHE
+        flushDataCache(baseAddress, RegisterFrame::Size);
+#endif
+    }
+    void storeFrameToBus(Address destination, const void* buffer, size_t count) noexcept {
+#ifdef STACK_CACHE
+        stackCache_.storeBlock(bus_, destination, buffer, count);
+#else
+        bus_.storeBlock(destination, buffer, count);
+#endif
+    }
+    void loadFrameFromBus(Address source, void* buffer, size_t count) noexcept {
+#ifdef STACK_CACHE
+        stackCache_.loadBlock(bus_, source, buffer, count);
+#else
+        bus_.loadBlock(source, buffer, count);
+#endif
+    }
+    /**
+     * @brief Slide the stack cache window along with the frame pointer after a call or return
+     */
+    void followFramePointer([[maybe_unused]] Address framePointer) noexcept {
+#ifdef STACK_CACHE
+        stackCache_.follow(bus_, framePointer);
+#endif
+    }
+    /**
+     * @brief Make the bus coherent with the data cache by writing back and dropping every cached line (or draining the
+     * store buffer)
+     */
+    void flushDataCache() noexcept {
+#ifdef DATA_CACHE
+        dataCache_.flush(bus_);
+#elif defined(STORE_BUFFER)
+        storeBuffer_.drain(bus_);
+#elif defined(STACK_CACHE)
+        stackCache_.flush(bus_);
+#endif
+    }
+    /**
+     * @brief Make the bus current without giving up any cached lines
+     */
+    void writeBackDataCache() noexcept {
+#ifdef DATA_CACHE
+        dataCache_.writeBack(bus_);
+#elif defined(STORE_BUFFER)
+        storeBuffer_.drain(bus_);
+#elif defined(STACK_CACHE)
+        stackCache_.writeBack(bus_);
+#endif
+    }
+    void writeBackDataCache([[maybe_unused]] Address destination, [[maybe_unused]] size_t count) noexcept {
+#ifdef DATA_CACHE
+        dataCache_.writeBack(bus_, destination, count);
+#elif defined(STORE_BUFFER)
+        storeBuffer_.drain(bus_, destination, count);
+#elif defined(STACK_CACHE)
+        stackCache_.writeBack(bus_, destination, count);
+#endif
+    }
+    /**
+     * @brief Write back and drop only the cached lines covering the given range, needed before talking to the bus directly
+     */
+    void flushDataCache([[maybe_unused]] Address destination, [[maybe_unused]] size_t count) noexcept {
+#ifdef DATA_CACHE
+        dataCache_.flush(bus_, destination, count);
+#elif defined(STORE_BUFFER)
+        storeBuffer_.drain(bus_, destination, count);
+#elif defined(STACK_CACHE)
+        stackCache_.flush(bus_, destination, count);
+#endif
+    }
+    /**
+     * @brief Can the given range be moved with a single block transfer; it has to stay out of internal space and the bus
+     * has to be able to reach all of it without reconfiguring
+     */
+    [[nodiscard]] bool canTransferBlock(Address destination, size_t count) const noexcept {
+        return !inInternalSpace(destination) && !inInternalSpace(destination + (count - 1)) && bus_.isContiguous(destination, count);
     }
 private: // fault handling
     void generateFault(FaultType fault) noexcept;
@@ -754,8 +1321,28 @@ private:
     ArithmeticControls ac_;
     ProcessControls pc_;
     TraceControls tc_;
-    // use a circular queue to store the last n local registers "on-chip"
-    RegisterFrame globals;
+    /**
+     * @brief Every register the core has in one contiguous block: a window for each pack of the ring, one for
+     * staleFrame_, the globals and then the literals 0-31 so operand lookups never have to special case them. Windows
+     * are spilled and filled with a single block transfer.
+     */
+    static constexpr Ordinal GlobalsWindow = NumRegisterFrames + 1;
+    static constexpr Ordinal LiteralsWindow = GlobalsWindow + 1;
+    static constexpr Ordinal GlobalsBase = (GlobalsWindow - 1) * 16;
+    /**
+     * @brief The register right after the literals, it always holds zero and is what unused operand fields read
+     */
+    static constexpr Ordinal ZeroRegister = (LiteralsWindow + 2) * 16;
+    static_assert(ZeroRegister == GlobalsBase + 64, "Bad operands are folded onto the slot after the literals");
+    union RegisterFile {
+        RegisterFile() noexcept : windows() { }
+        RegisterFrame windows[LiteralsWindow + 2];
+        Register registers[ZeroRegister + 1];
+    } registerFile_;
+    /**
+     * @brief registerFile_ index of r0 of the current frame
+     */
+    Ordinal localsBase_ = 0;
 #ifdef NUMERICS_ARCHITECTURE
     ExtendedReal fpRegs[4] = { 0 };
 #endif
@@ -765,57 +1352,53 @@ private:
     Address stackAlignMask_;
     Address frameAlignmentMask_;
     Ordinal currentFrameIndex_ = 0;
+    // use a circular queue to store the last n local registers "on-chip"
     LocalRegisterPack frames[NumRegisterFrames];
+    /**
+     * @brief The last pack evicted from the ring, held back so a return to it straight after (a call/return pair at
+     * ring depth) costs no memory traffic. It is only written to the stack when another eviction needs the slot, on
+     * flushreg, or when guest code touches the frame's memory.
+     */
+    LocalRegisterPack staleFrame_;
+#ifdef FRAME_STORE
+    FrameStore frameStore_;
+#endif
+    uint32_t frameSpills_ = 0;
+    uint32_t frameFills_ = 0;
     Ordinal systemAddressTableBase_ = 0;
     Ordinal prcbBase_ = 0;
     byte internalSRAM_[NumSRAMBytesMapped] = { 0 };
-    Address ebiUpper_ = 0xFFFF'FFFF;
-};
-enum class Pinout {
-    // expose four controllable interrupts
-    Int0_ = 19,
-    Int1_ = 18,
-    Int2_ = 2,
-    Int3_ = 3,
-    /**
-     * @brief The real EBI_A15 is used to select which 32k window to write to in the EBI space. Thus we take A15 into our own hands when dealing with the external bus
-     */
-    EBI_A15 = 38,
-    EBI_A16 = 49,
-    EBI_A17 = 48,
-    EBI_A18 = 47,
-    EBI_A19 = 46,
-    EBI_A20 = 45,
-    EBI_A21 = 44,
-    EBI_A22 = 43,
-    EBI_A23 = 42,
-    EBI_A24 = A8,
-    EBI_A25 = A9,
-    EBI_A26 = A10,
-    EBI_A27 = A11,
-    EBI_A28 = A12,
-    EBI_A29 = A13,
-    EBI_A30 = A14,
-    EBI_A31 = A15,
-};
-static constexpr Pinout EBIExtendedPins[] {
-        Pinout::EBI_A15 ,
-        Pinout::EBI_A16 ,
-        Pinout::EBI_A17 ,
-        Pinout::EBI_A18 ,
-        Pinout::EBI_A19 ,
-        Pinout::EBI_A20 ,
-        Pinout::EBI_A21 ,
-        Pinout::EBI_A22 ,
-        Pinout::EBI_A23 ,
-        Pinout::EBI_A24 ,
-        Pinout::EBI_A25 ,
-        Pinout::EBI_A26 ,
-        Pinout::EBI_A27 ,
-        Pinout::EBI_A28 ,
-        Pinout::EBI_A29 ,
-        Pinout::EBI_A30 ,
-        Pinout::EBI_A31 ,
+    BusBackend bus_;
+#ifdef DATA_CACHE
+    DataCache dataCache_;
+#elif defined(STORE_BUFFER)
+    StoreBuffer storeBuffer_;
+#elif defined(STACK_CACHE)
+    StackCache stackCache_;
+#endif
+    DecodedInstruction instructionCache_[NumInstructionCacheEntries];
+    DecodedBlock blockCache_[NumBlockCacheEntries];
+    /**
+     * @brief Bounds of the bytes covered by the valid instruction cache entries, only ever grows until the next purge. Blocks
+     * are built out of the instruction cache so this covers them as well
+     */
+    Address instructionCacheLowest_ = 0xFFFF'FFFF;
+    Address instructionCacheHighest_ = 0;
+    static constexpr Address PrefetchSize = 16;
+    static constexpr Address PrefetchMask = ~(PrefetchSize - 1);
+    /**
+     * @brief Like the fetch unit on the real chip, the next aligned 16 bytes of the instruction stream are read in one
+     * transaction and instructions are pulled out of it a word at a time. The range is folded into the instruction cache
+     * bounds so stores to it are noticed.
+     */
+    Address prefetchAddress_ = DecodedInstruction::InvalidAddress;
+    Ordinal prefetchBuffer_[PrefetchSize / sizeof(Ordinal)] = { 0 };
+#ifdef HOST_JIT
+    X86BlockTranslator translator_;
+#endif
+#ifdef PROFILE_INSTRUCTIONS
+    Profiler profiler_;
+#endif
 };
 namespace Builtin
 {
@@ -831,6 +1414,7 @@ namespace Builtin
         Timers,
         AnalogToDigitalConverters,
         JTAG,
+        DMA,
         Count,
         Error = Count,
     };
@@ -851,8 +1435,127 @@ namespace Builtin
         return static_cast<Devices>(static_cast<byte>(address >> 8));
     }
 }
-void pinMode(Pinout p, decltype(OUTPUT) direction) noexcept;
-void digitalWrite(Pinout p, decltype(HIGH) value) noexcept;
-byte digitalRead(Pinout p) noexcept;
+constexpr Core::InternalRegion
+Core::classifyInternalAddress(Address destination) noexcept {
+    switch (static_cast<byte>(destination >> 16)) {
+        case static_cast<byte>(Builtin::InternalBootProgramBase >> 16):
+            return InternalRegion::BootProgram;
+        case static_cast<byte>(Builtin::InternalSRAMBase >> 16):
+            // only the start of the 64k block is backed by sram, the rest is passed through
+            return destination < Builtin::InternalSRAMEnd ? InternalRegion::SRAM : InternalRegion::Bus;
+        case static_cast<byte>(Builtin::InternalPeripheralBase >> 16):
+            return destination >= Builtin::ConfigurationSpaceBaseAddress ? InternalRegion::ConfigurationSpace : InternalRegion::Peripherals;
+        default:
+            return InternalRegion::Bus;
+    }
+}
+constexpr Core::InternalRegion
+Core::classifyInternalAccess(Address destination, size_t count) noexcept {
+    auto region = classifyInternalAddress(destination);
+    if (auto last = destination + (count - 1); !inInternalSpace(last) || classifyInternalAddress(last) != region) {
+        return InternalRegion::Peripherals;
+    }
+    return region;
+}
+template<typename T>
+typename TreatAs<T>::UnderlyingType
+Core::loadFromInternalSpace(Address destination, TreatAs<T>) noexcept {
+    union {
+        byte bytes[sizeof(T)] ;
+        T value;
+    } container;
+    switch (classifyInternalAccess(destination, sizeof(T))) {
+        case InternalRegion::SRAM:
+            memcpy(container.bytes, internalSRAM_ + (destination - Builtin::InternalSRAMBase), sizeof(T));
+            break;
+        case InternalRegion::BootProgram:
+            readFromInternalBootProgram(static_cast<size_t>(destination - Builtin::InternalBootProgramBase), container.bytes, sizeof(T));
+            break;
+        case InternalRegion::Bus:
+            return loadFromBus(destination, TreatAs<T>{});
+        default:
+            // device registers have side effects on access so they only ever see single byte transfers
+            for (size_t i = 0; i < sizeof(T); ++i, ++destination) {
+                container.bytes[i] = readFromInternalSpace(destination);
+            }
+            break;
+    }
+    return container.value;
+}
+template<typename T>
+void
+Core::storeToInternalSpace(Address destination, T value, TreatAs<T>) noexcept {
+    switch (classifyInternalAccess(destination, sizeof(T))) {
+        case InternalRegion::SRAM:
+            memcpy(internalSRAM_ + (destination - Builtin::InternalSRAMBase), &value, sizeof(T));
+            break;
+        case InternalRegion::BootProgram:
+            // ignore writes made to this location
+            break;
+        case InternalRegion::Bus:
+            storeToBus(destination, value, TreatAs<T>{});
+            break;
+        default: {
+            union {
+                byte bytes[sizeof(T)] ;
+                T value;
+            } container;
+            container.value = value;
+            for (size_t i = 0; i < sizeof(T); ++i, ++destination) {
+                writeToInternalSpace(destination, container.bytes[i]);
+            }
+            break;
+        }
+    }
+}
+inline void
+Core::readBlock(Address source, byte* buffer, size_t count) noexcept {
+    writeBackStaleFrame(source, count);
+    if (canTransferBlock(source, count)) {
+        loadBlockFromBus(source, buffer, count);
+        return;
+    }
+    switch (inInternalSpace(source) ? classifyInternalAccess(source, count) : InternalRegion::Peripherals) {
+        case InternalRegion::SRAM:
+            memcpy(buffer, internalSRAM_ + (source - Builtin::InternalSRAMBase), count);
+            break;
+        case InternalRegion::BootProgram:
+            readFromInternalBootProgram(static_cast<size_t>(source - Builtin::InternalBootProgramBase), buffer, count);
+            break;
+        case InternalRegion::Bus:
+            loadBlockFromBus(source, buffer, count);
+            break;
+        default:
+            for (size_t i = 0; i < count; ++i) {
+                buffer[i] = loadByte(source + i);
+            }
+            break;
+    }
+}
+inline void
+Core::writeBlock(Address destination, const byte* buffer, size_t count) noexcept {
+    invalidateInstructionCache(destination, count);
+    writeBackStaleFrame(destination, count);
+    if (canTransferBlock(destination, count)) {
+        storeBlockToBus(destination, buffer, count);
+        return;
+    }
+    switch (inInternalSpace(destination) ? classifyInternalAccess(destination, count) : InternalRegion::Peripherals) {
+        case InternalRegion::SRAM:
+            memcpy(internalSRAM_ + (destination - Builtin::InternalSRAMBase), buffer, count);
+            break;
+        case InternalRegion::Bus:
+            storeBlockToBus(destination, buffer, count);
+            break;
+        case InternalRegion::BootProgram:
+            // ignore writes made to this location
+            break;
+        default:
+            for (size_t i = 0; i < count; ++i) {
+                storeByte(destination + i, buffer[i]);
+            }
+            break;
+    }
+}
 [[noreturn]] void haltExecution(const __FlashStringHelper* message) noexcept;
 #endif //SIM3_CORE_H
@@ -0,0 +1,271 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#ifndef SIM_ECORE_DATACACHE_H
+#define SIM_ECORE_DATACACHE_H
+#ifdef DATA_CACHE
+#include <string.h>
+#include "BusBackend.h"
+#ifdef DESKTOP_BUILD
+#include <memory>
+#endif
+
+/**
+ * @brief Two way set associative, write back cache of external memory which sits between the core and the bus backend.
+ * On the AVR the lines live in the otherwise unused lower 32k EBI window so a hit never has to touch the upper address
+ * lines; desktop builds keep them on the heap. Lines are tagged with the address the backend folds aliases to so every
+ * name for a byte finds the same line.
+ */
+class DataCache {
+public:
+    static constexpr size_t LineSize = 16;
+    static constexpr size_t NumWays = 2;
+    static constexpr size_t NumSets = 512;
+    static constexpr size_t NumLines = NumWays * NumSets;
+    static_assert((NumSets & (NumSets - 1)) == 0, "The number of sets must be a power of two");
+    struct Line {
+        static constexpr Address Valid = 0b01;
+        static constexpr Address Dirty = 0b10;
+        static constexpr Address TagMask = ~static_cast<Address>(LineSize - 1);
+        [[nodiscard]] constexpr bool matches(Address lineAddress) const noexcept { return (tag_ & (TagMask | Valid)) == (lineAddress | Valid); }
+        [[nodiscard]] constexpr bool isValid() const noexcept { return tag_ & Valid; }
+        [[nodiscard]] constexpr bool isDirty() const noexcept { return tag_ & Dirty; }
+        [[nodiscard]] constexpr Address getAddress() const noexcept { return tag_ & TagMask; }
+        /**
+         * @brief The address of the line with the valid and dirty flags folded into the (always zero) low bits
+         */
+        Address tag_;
+        byte data_[LineSize];
+    };
+    static constexpr size_t StorageSize = sizeof(Line) * NumLines;
+#ifdef DESKTOP_BUILD
+    DataCache() : storage_(std::make_unique<Line[]>(NumLines)), lines_(storage_.get()) { }
+#else
+    static_assert((CacheMemoryWindowStart + StorageSize) <= 0x8000, "Data cache does not fit in the lower EBI window");
+    DataCache() noexcept : lines_(reinterpret_cast<Line*>(CacheMemoryWindowStart)) { }
+#endif
+    /**
+     * @brief Throw away every line without writing anything back; the lower window contents are garbage at power on
+     */
+    void clear() noexcept {
+        for (size_t i = 0; i < NumLines; ++i) {
+            lines_[i].tag_ = 0;
+        }
+        memset(mostRecent_, 0, sizeof(mostRecent_));
+        memset(dirtySets_, 0, sizeof(dirtySets_));
+        resetDirtyRange();
+    }
+    template<typename T>
+    T load(BusBackend& bus, Address destination) noexcept {
+        destination = bus.physicalAddress(destination);
+        auto offset = destination & (LineSize - 1);
+        if ((offset + sizeof(T)) > LineSize) {
+            // straddles two lines, rare enough that making the bus coherent and going around the cache is fine
+            flush(bus, destination, sizeof(T));
+            return bus.load(destination, TreatAs<T>{});
+        }
+        T value;
+        memcpy(&value, lookup(bus, destination).data_ + offset, sizeof(T));
+        return value;
+    }
+    template<typename T>
+    void store(BusBackend& bus, Address destination, T value) noexcept {
+        destination = bus.physicalAddress(destination);
+        auto offset = destination & (LineSize - 1);
+        if ((offset + sizeof(T)) > LineSize) {
+            flush(bus, destination, sizeof(T));
+            bus.store(destination, value, TreatAs<T>{});
+            return;
+        }
+        auto& line = lookup(bus, destination);
+        memcpy(line.data_ + offset, &value, sizeof(T));
+        markDirty(line, destination);
+    }
+    /**
+     * @brief Read a block through the cache when it sits inside one line (a quad word for instance), otherwise make the
+     * bus current for the range and read it directly
+     */
+    void loadBlock(BusBackend& bus, Address destination, void* buffer, size_t count) noexcept {
+        destination = bus.physicalAddress(destination);
+        if (auto offset = destination & (LineSize - 1); (offset + count) <= LineSize) {
+            memcpy(buffer, lookup(bus, destination).data_ + offset, count);
+        } else {
+            writeBack(bus, destination, count);
+            bus.loadBlock(destination, buffer, count);
+        }
+    }
+    void storeBlock(BusBackend& bus, Address destination, const void* buffer, size_t count) noexcept {
+        destination = bus.physicalAddress(destination);
+        if (auto offset = destination & (LineSize - 1); (offset + count) <= LineSize) {
+            auto& line = lookup(bus, destination);
+            memcpy(line.data_ + offset, buffer, count);
+            markDirty(line, destination);
+        } else {
+            flush(bus, destination, count);
+            bus.storeBlock(destination, buffer, count);
+        }
+    }
+    /**
+     * @brief Write every dirty line back to the bus but keep them all cached; only the sets marked dirty are visited so
+     * this is cheap when little has been written since the last time
+     */
+    void writeBack(BusBackend& bus) noexcept {
+        for (size_t i = dirtyLowest_; i <= dirtyHighest_; ++i) {
+            if (auto sets = dirtySets_[i]; sets != 0) {
+                for (size_t bit = 0; bit < 8; ++bit) {
+                    if (sets & (1 << bit)) {
+                        auto ways = &lines_[((i * 8) + bit) * NumWays];
+                        for (size_t way = 0; way < NumWays; ++way) {
+                            writeBack(bus, ways[way]);
+                        }
+                    }
+                }
+                dirtySets_[i] = 0;
+            }
+        }
+        resetDirtyRange();
+    }
+    /**
+     * @brief Write back every dirty line and then invalidate the whole cache
+     */
+    void flush(BusBackend& bus) noexcept {
+        writeBack(bus);
+        for (size_t i = 0; i < NumLines; ++i) {
+            lines_[i].tag_ = 0;
+        }
+    }
+    /**
+     * @brief Write back only the lines which overlap the given range, they stay cached
+     */
+    void writeBack(BusBackend& bus, Address destination, size_t count) noexcept {
+        if (destination = bus.physicalAddress(destination); !bus.isContiguous(destination, count)) {
+            // wraps around the end of ram, not worth working out which lines that touches
+            writeBack(bus);
+        } else {
+            forEachCachedLine(destination, count, [&bus](Line& line) noexcept { writeBack(bus, line); });
+        }
+    }
+    /**
+     * @brief Write back and invalidate only the lines which overlap the given range, used before the core talks to the bus
+     * directly
+     */
+    void flush(BusBackend& bus, Address destination, size_t count) noexcept {
+        if (destination = bus.physicalAddress(destination); !bus.isContiguous(destination, count)) {
+            flush(bus);
+        } else {
+            forEachCachedLine(destination, count, [&bus](Line& line) noexcept {
+                writeBack(bus, line);
+                line.tag_ = 0;
+            });
+        }
+    }
+private:
+    [[nodiscard]] static constexpr size_t computeSet(Address destination) noexcept {
+        return (destination / LineSize) & (NumSets - 1);
+    }
+    void markDirty(Line& line, Address destination) noexcept {
+        line.tag_ |= Line::Dirty;
+        auto set = computeSet(destination);
+        auto group = set / 8;
+        dirtySets_[group] |= (1 << (set & 0b111));
+        if (group < dirtyLowest_) {
+            dirtyLowest_ = group;
+        }
+        if (group > dirtyHighest_) {
+            dirtyHighest_ = group;
+        }
+    }
+    void resetDirtyRange() noexcept {
+        // empty range, lowest > highest
+        dirtyLowest_ = sizeof(dirtySets_);
+        dirtyHighest_ = 0;
+    }
+    template<typename Action>
+    void forEachCachedLine(Address destination, size_t count, Action action) noexcept {
+        auto last = (destination + (count - 1)) & Line::TagMask;
+        for (auto lineAddress = destination & Line::TagMask; ; lineAddress += LineSize) {
+            auto ways = &lines_[computeSet(lineAddress) * NumWays];
+            for (size_t way = 0; way < NumWays; ++way) {
+                if (ways[way].matches(lineAddress)) {
+                    action(ways[way]);
+                }
+            }
+            if (lineAddress == last) {
+                break;
+            }
+        }
+    }
+    static void writeBack(BusBackend& bus, Line& line) noexcept {
+        if (line.isValid() && line.isDirty()) {
+            bus.storeBlock(line.getAddress(), line.data_, LineSize);
+            line.tag_ &= ~Line::Dirty;
+        }
+    }
+    void touch(size_t set, size_t way) noexcept {
+        if (way) {
+            mostRecent_[set / 8] |= (1 << (set & 0b111));
+        } else {
+            mostRecent_[set / 8] &= ~(1 << (set & 0b111));
+        }
+    }
+    [[nodiscard]] size_t leastRecentlyUsed(size_t set) const noexcept {
+        return (mostRecent_[set / 8] & (1 << (set & 0b111))) ? 0 : 1;
+    }
+    Line& lookup(BusBackend& bus, Address destination) noexcept {
+        auto lineAddress = destination & Line::TagMask;
+        auto set = computeSet(destination);
+        auto ways = &lines_[set * NumWays];
+        for (size_t way = 0; way < NumWays; ++way) {
+            if (ways[way].matches(lineAddress)) {
+                touch(set, way);
+                return ways[way];
+            }
+        }
+        auto victim = leastRecentlyUsed(set);
+        auto& line = ways[victim];
+        writeBack(bus, line);
+        bus.loadBlock(lineAddress, line.data_, LineSize);
+        line.tag_ = lineAddress | Line::Valid;
+        touch(set, victim);
+        return line;
+    }
+private:
+#ifdef DESKTOP_BUILD
+    std::unique_ptr<Line[]> storage_;
+#endif
+    Line* lines_;
+    /**
+     * @brief One bit per set saying which way was used last, kept in internal sram since it is touched on every access
+     */
+    byte mostRecent_[NumSets / 8] = { 0 };
+    /**
+     * @brief One bit per set which may be holding a dirty line
+     */
+    byte dirtySets_[NumSets / 8] = { 0 };
+    /**
+     * @brief Bounds on which bytes of dirtySets_ can be non zero so a write back only scans what was touched
+     */
+    size_t dirtyLowest_ = sizeof(dirtySets_);
+    size_t dirtyHighest_ = 0;
+};
+#endif
+#endif //SIM_ECORE_DATACACHE_H
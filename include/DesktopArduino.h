@@ -0,0 +1,99 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Host side stand-ins for the small slice of the Arduino API that the emulator core touches (Serial, F(), delay, etc).
+// This is only pulled in when DESKTOP_BUILD is defined so that the core can be compiled and profiled off-board.
+#ifndef SIM_ECORE_DESKTOPARDUINO_H
+#define SIM_ECORE_DESKTOPARDUINO_H
+#ifdef DESKTOP_BUILD
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <thread>
+
+using byte = uint8_t;
+constexpr int DEC = 10;
+constexpr int HEX = 16;
+constexpr int LOW = 0;
+constexpr int HIGH = 1;
+constexpr int INPUT = 0;
+constexpr int OUTPUT = 1;
+#ifndef F_CPU
+// report the same clock as the i960Sx board the emulator normally runs on
+#define F_CPU 20000000UL
+#endif
+/**
+ * @brief On the AVR this marks a string as living in program memory, on the host it is just a plain C string
+ */
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+inline void delay(unsigned long ms) noexcept {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+/**
+ * @brief Routes the Arduino Serial interface to stdin/stdout
+ */
+class DesktopSerial {
+public:
+    void begin(unsigned long) noexcept { }
+    void end() noexcept { }
+    [[nodiscard]] explicit operator bool() const noexcept { return true; }
+    [[nodiscard]] int available() const noexcept { return 1; }
+    [[nodiscard]] int availableForWrite() const noexcept { return 64; }
+    [[nodiscard]] int read() noexcept { return std::getchar(); }
+    size_t write(uint8_t value) noexcept {
+        std::putchar(value);
+        return 1;
+    }
+    void flush() noexcept { std::fflush(stdout); }
+    void print(const char* str) noexcept { std::fputs(str, stdout); }
+    void print(const __FlashStringHelper* str) noexcept { print(reinterpret_cast<const char*>(str)); }
+    void print(char c) noexcept { std::putchar(c); }
+    template<typename T>
+    void print(T value, int base = DEC) noexcept {
+        if (base == HEX) {
+            std::printf("%llX", static_cast<unsigned long long>(value));
+        } else if constexpr (static_cast<T>(-1) < static_cast<T>(0)) {
+            std::printf("%lld", static_cast<long long>(value));
+        } else {
+            std::printf("%llu", static_cast<unsigned long long>(value));
+        }
+    }
+    void println() noexcept { std::putchar('\n'); }
+    template<typename T>
+    void println(T value) noexcept {
+        print(value);
+        println();
+    }
+    template<typename T>
+    void println(T value, int base) noexcept {
+        print(value, base);
+        println();
+    }
+};
+inline DesktopSerial Serial;
+#endif
+#endif //SIM_ECORE_DESKTOPARDUINO_H
@@ -0,0 +1,272 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SIM_ECORE_EBIBUSBACKEND_H
+#define SIM_ECORE_EBIBUSBACKEND_H
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "Types.h"
+
+template<typename T>
+inline volatile T& memory(const size_t address) noexcept {
+    return *reinterpret_cast<T*>(address);
+}
+enum class Pinout {
+    // expose four controllable interrupts
+    Int0_ = 19,
+    Int1_ = 18,
+    Int2_ = 2,
+    Int3_ = 3,
+    /**
+     * @brief The real EBI_A15 is used to select which 32k window to write to in the EBI space. Thus we take A15 into our own hands when dealing with the external bus
+     */
+    EBI_A15 = 38,
+    EBI_A16 = 49,
+    EBI_A17 = 48,
+    EBI_A18 = 47,
+    EBI_A19 = 46,
+    EBI_A20 = 45,
+    EBI_A21 = 44,
+    EBI_A22 = 43,
+    EBI_A23 = 42,
+    EBI_A24 = A8,
+    EBI_A25 = A9,
+    EBI_A26 = A10,
+    EBI_A27 = A11,
+    EBI_A28 = A12,
+    EBI_A29 = A13,
+    EBI_A30 = A14,
+    EBI_A31 = A15,
+};
+static constexpr Pinout EBIExtendedPins[] {
+        Pinout::EBI_A15 ,
+        Pinout::EBI_A16 ,
+        Pinout::EBI_A17 ,
+        Pinout::EBI_A18 ,
+        Pinout::EBI_A19 ,
+        Pinout::EBI_A20 ,
+        Pinout::EBI_A21 ,
+        Pinout::EBI_A22 ,
+        Pinout::EBI_A23 ,
+        Pinout::EBI_A24 ,
+        Pinout::EBI_A25 ,
+        Pinout::EBI_A26 ,
+        Pinout::EBI_A27 ,
+        Pinout::EBI_A28 ,
+        Pinout::EBI_A29 ,
+        Pinout::EBI_A30 ,
+        Pinout::EBI_A31 ,
+};
+void pinMode(Pinout p, decltype(OUTPUT) direction) noexcept;
+void digitalWrite(Pinout p, decltype(HIGH) value) noexcept;
+byte digitalRead(Pinout p) noexcept;
+
+/**
+ * @brief Defines the start of the internal cache memory connected on the EBI, this is used by the microcontroller itself for whatever it needs (lower 32k)
+ */
+constexpr size_t CacheMemoryWindowStart = (RAMEND + 1);
+
+/**
+ * @brief Bus backend which maps the i960 address space onto the upper 32k window of the ATmega2560 EBI. The upper 17 address
+ * lines are driven by hand through PORTL, PORTK, and a fake A15.
+ */
+class EBIBusBackend {
+public:
+    static constexpr Address WindowSize = 0x8000;
+    static constexpr Address WindowMask = WindowSize - 1;
+public:
+    template<typename T>
+    typename TreatAs<T>::UnderlyingType load(Address destination, TreatAs<T>) noexcept {
+        if (staysInWindow(destination, sizeof(T))) {
+            setEBIUpper(destination);
+            return memory<T>(computeWindowOffsetAddress(destination));
+        } else {
+            // the bytes straddle two windows so each half has to be read with its own A15-A31 setup
+            T value;
+            loadBlock(destination, &value, sizeof(T));
+            return value;
+        }
+    }
+    template<typename T>
+    void store(Address destination, T value, TreatAs<T>) noexcept {
+        if (staysInWindow(destination, sizeof(T))) {
+            setEBIUpper(destination);
+            memory<T>(computeWindowOffsetAddress(destination)) = value;
+        } else {
+            storeBlock(destination, &value, sizeof(T));
+        }
+    }
+    /**
+     * @brief Can the given range be moved with a single block transfer; always true since the transfer planner splits
+     * blocks at window boundaries
+     */
+    [[nodiscard]] static constexpr bool isContiguous(Address, size_t) noexcept { return true; }
+    /**
+     * @brief Can both addresses be reached without reprogramming the upper address lines
+     */
+    [[nodiscard]] static constexpr bool sameWindow(Address first, Address second) noexcept { return ((first ^ second) & ~WindowMask) == 0; }
+    /**
+     * @brief All 32 address lines are decoded so nothing aliases
+     */
+    [[nodiscard]] static constexpr Address physicalAddress(Address address) noexcept { return address; }
+    /**
+     * @brief Copy count bytes out of the bus, the window is only switched where the range actually crosses a boundary
+     */
+    void loadBlock(Address destination, void* buffer, size_t count) noexcept {
+        auto bytes = reinterpret_cast<byte*>(buffer);
+        planTransfer(destination, count, [&bytes](size_t window, size_t amount) noexcept {
+            if ((amount & 0b11) == 0) {
+                auto words = reinterpret_cast<Ordinal*>(bytes);
+                for (size_t i = 0; i < amount; i += sizeof(Ordinal), ++words) {
+                    *words = memory<Ordinal>(window + i);
+                }
+            } else {
+                for (size_t i = 0; i < amount; ++i) {
+                    bytes[i] = memory<byte>(window + i);
+                }
+            }
+            bytes += amount;
+        });
+    }
+    /**
+     * @brief Copy count bytes onto the bus, the window is only switched where the range actually crosses a boundary
+     */
+    void storeBlock(Address destination, const void* buffer, size_t count) noexcept {
+        auto bytes = reinterpret_cast<const byte*>(buffer);
+        planTransfer(destination, count, [&bytes](size_t window, size_t amount) noexcept {
+            if ((amount & 0b11) == 0) {
+                auto words = reinterpret_cast<const Ordinal*>(bytes);
+                for (size_t i = 0; i < amount; i += sizeof(Ordinal), ++words) {
+                    memory<Ordinal>(window + i) = *words;
+                }
+            } else {
+                for (size_t i = 0; i < amount; ++i) {
+                    memory<byte>(window + i) = bytes[i];
+                }
+            }
+            bytes += amount;
+        });
+    }
+    /**
+     * @brief Keep interrupt handlers off the bus (and away from the upper address lines) for the length of a read-modify-write
+     */
+    void lockBus() noexcept {
+        savedSREG_ = SREG;
+        cli();
+    }
+    void unlockBus() noexcept {
+        SREG = savedSREG_;
+    }
+    Ordinal atomicAdd(Address destination, Ordinal value) noexcept {
+        lockBus();
+        auto old = load(destination, TreatAsOrdinal{});
+        store(destination, old + value, TreatAsOrdinal{});
+        unlockBus();
+        return old;
+    }
+    Ordinal atomicModify(Address destination, Ordinal mask, Ordinal value) noexcept {
+        lockBus();
+        auto old = load(destination, TreatAsOrdinal{});
+        store(destination, (value & mask) | (old & ~mask), TreatAsOrdinal{});
+        unlockBus();
+        return old;
+    }
+    [[nodiscard]] ByteOrdinal readConfigurationSpace(Address offset) noexcept { return EEPROM.read(static_cast<int>(offset & 0xFFF)); }
+    void writeConfigurationSpace(Address offset, byte value) noexcept { EEPROM.update(static_cast<int>(offset & 0xFFF), value); }
+    /**
+     * @brief How many times the upper address lines have been reprogrammed
+     */
+    [[nodiscard]] uint32_t getWindowSwitches() const noexcept { return windowSwitches_; }
+    /**
+     * @brief How many accesses had to be broken up because they crossed a window boundary
+     */
+    [[nodiscard]] uint32_t getSplitTransfers() const noexcept { return splitTransfers_; }
+    void clearStatistics() noexcept {
+        windowSwitches_ = 0;
+        splitTransfers_ = 0;
+    }
+private:
+    [[nodiscard]] static constexpr bool staysInWindow(Address destination, size_t count) noexcept {
+        return count <= WindowSize && (destination & WindowMask) <= (WindowSize - count);
+    }
+    /**
+     * @brief Walk a transfer one window at a time, handing each piece to the given function along with where it lives in
+     * the EBI window and how many bytes it covers
+     */
+    template<typename Transfer>
+    void planTransfer(Address destination, size_t count, Transfer transfer) noexcept {
+        if (!staysInWindow(destination, count)) {
+            ++splitTransfers_;
+        }
+        while (count > 0) {
+            size_t amount = WindowSize - (destination & WindowMask);
+            if (amount > count) {
+                amount = count;
+            }
+            setEBIUpper(destination);
+            transfer(computeWindowOffsetAddress(destination), amount);
+            destination += amount;
+            count -= amount;
+        }
+    }
+    inline void setEBIUpper(Address address) noexcept {
+        static constexpr Address upperMask = ~WindowMask;
+        static constexpr Address bit15Mask = WindowSize;
+        auto realAddress = address & upperMask;
+        if (auto changed = realAddress ^ ebiUpper_; changed != 0) {
+            ++windowSwitches_;
+            // walking a buffer only flips A15 so leave the other ports alone unless their lines actually changed.
+            // The fake A15 is digital pin 38 which is PD7 on the 2560; a single sbi/cbi instead of a digitalWrite
+            if (changed & bit15Mask) {
+                if (realAddress & bit15Mask) {
+                    PORTD |= _BV(PD7);
+                } else {
+                    PORTD &= ~_BV(PD7);
+                }
+            }
+            if (changed & 0x00FF'0000) {
+                PORTL = static_cast<byte>(realAddress >> 16);
+            }
+            if (changed & 0xFF00'0000) {
+                PORTK = static_cast<byte>(realAddress >> 24);
+            }
+            ebiUpper_ = realAddress;
+        }
+    }
+    /**
+     * @brief Compute the actual address within the EBI window
+     * @param offset The lower 16-bits of the address
+     * @return The adjusted window address
+     */
+    [[nodiscard]] static constexpr size_t computeWindowOffsetAddress(Address offset) noexcept {
+        return WindowSize + (static_cast<size_t>(offset) & WindowMask);
+    }
+private:
+    Address ebiUpper_ = 0xFFFF'FFFF;
+    uint32_t windowSwitches_ = 0;
+    uint32_t splitTransfers_ = 0;
+    byte savedSREG_ = 0;
+};
+#endif
+#endif //SIM_ECORE_EBIBUSBACKEND_H
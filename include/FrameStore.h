@@ -0,0 +1,216 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#ifndef SIM_ECORE_FRAMESTORE_H
+#define SIM_ECORE_FRAMESTORE_H
+#ifdef FRAME_STORE
+#include <string.h>
+#include "BusBackend.h"
+#include "Register.h"
+#include "DataCache.h"
+#ifdef DESKTOP_BUILD
+#include <memory>
+#endif
+
+/**
+ * @brief How many evicted register frames the frame store holds (a power of two). The mega2560 fits 32 next to the
+ * data cache in the lower EBI window and 128 without it.
+ */
+#ifndef NUM_STORED_FRAMES
+#if defined(DESKTOP_BUILD) || !defined(DATA_CACHE)
+#define NUM_STORED_FRAMES 128
+#else
+#define NUM_STORED_FRAMES 32
+#endif
+#endif
+
+/**
+ * @brief Second level of on chip register frames. Frames pushed off the end of the register ring land here, together
+ * with their dirty and not yet loaded state, instead of being written to their stack slots. Returning to one moves it
+ * straight back into a pack. Call chains evict and restore frames in stack order, so the store is kept as a stack of
+ * slots and the oldest frame is written out to memory once it is full. On the AVR the slots live in the lower 32k EBI
+ * window, right after the data cache lines, so they cost no internal sram and never need the upper address lines;
+ * desktop builds keep them on the heap.
+ */
+class FrameStore {
+public:
+    static constexpr size_t NumEntries = NUM_STORED_FRAMES;
+    static constexpr size_t EntryMask = NumEntries - 1;
+    static_assert(NumEntries >= 2 && (NumEntries & EntryMask) == 0, "The frame store size must be a power of two");
+    // every held frame adds at most one to a bucket and the bucket counts are single bytes
+    static_assert(NumEntries < 256, "The frame store can hold at most 128 frames");
+    struct Entry {
+        RegisterFrame registers_;
+        Address framePointer_;
+        uint16_t dirty_;
+        byte unloadedQuads_;
+        bool valid_;
+    };
+    static constexpr size_t StorageSize = sizeof(Entry) * NumEntries;
+#ifdef DESKTOP_BUILD
+    FrameStore() : storage_(std::make_unique<Entry[]>(NumEntries)), entries_(storage_.get()) { }
+#else
+#ifdef DATA_CACHE
+    static constexpr size_t WindowStart = CacheMemoryWindowStart + DataCache::StorageSize;
+#else
+    static constexpr size_t WindowStart = CacheMemoryWindowStart;
+#endif
+    static_assert((WindowStart + StorageSize) <= 0x8000, "Frame store does not fit in the lower EBI window");
+    FrameStore() noexcept : entries_(reinterpret_cast<Entry*>(WindowStart)) { }
+#endif
+    /**
+     * @brief Keep a frame which is leaving the register ring; if every slot is taken the oldest frame is handed to spill
+     * to go out to memory
+     * @param spill Called with (registers, frame pointer, dirty mask) for a frame which has to be written to the stack
+     */
+    template<typename Spill>
+    void push(const RegisterFrame& registers, Address framePointer, uint16_t dirty, byte unloadedQuads, Spill spill) noexcept {
+        auto& entry = entries_[top_];
+        if (count_ == NumEntries) {
+            // the oldest slot is the one about to be reused
+            evict(entry, spill);
+            --count_;
+        }
+        memcpy(&entry.registers_, &registers, sizeof(RegisterFrame));
+        entry.framePointer_ = framePointer;
+        entry.dirty_ = dirty;
+        entry.unloadedQuads_ = unloadedQuads;
+        entry.valid_ = true;
+        mark(framePointer, 1);
+        top_ = (top_ + 1) & EntryMask;
+        ++count_;
+    }
+    /**
+     * @brief Take the frame at the given address back out of the store
+     * @param load Called with the entry to copy it into a register pack
+     * @return false if the frame is not held here and has to be read from memory
+     */
+    template<typename Load>
+    bool take(Address framePointer, Load load) noexcept {
+        if (!mayHold(framePointer, RegisterFrame::Size)) {
+            return false;
+        }
+        // returns normally come back for the newest frame, the scan only matters after stack switches
+        for (size_t i = 1; i <= count_; ++i) {
+            if (auto& entry = entries_[(top_ - i) & EntryMask]; entry.valid_ && entry.framePointer_ == framePointer) {
+                load(entry);
+                release(entry);
+                trimTop();
+                return true;
+            }
+        }
+        return false;
+    }
+    /**
+     * @brief Write out and forget every held frame which overlaps the given range, guest code is about to access it
+     */
+    template<typename Spill>
+    void writeBack(Address destination, size_t count, Spill spill) noexcept {
+        if (mayHold(destination, count)) {
+            for (size_t i = 1; i <= count_; ++i) {
+                if (auto& entry = entries_[(top_ - i) & EntryMask]; entry.valid_) {
+                    if (auto base = entry.framePointer_; (destination - base) < RegisterFrame::Size || (base - destination) < count) {
+                        evict(entry, spill);
+                    }
+                }
+            }
+        }
+    }
+    /**
+     * @brief Write out and forget everything (flushreg)
+     */
+    template<typename Spill>
+    void writeBack(Spill spill) noexcept {
+        for (size_t i = 1; i <= count_; ++i) {
+            evict(entries_[(top_ - i) & EntryMask], spill);
+        }
+        count_ = 0;
+    }
+    /**
+     * @brief Forget everything without writing it anywhere, the slots are garbage at power on and after a reboot
+     */
+    void clear() noexcept {
+        count_ = 0;
+        memset(buckets_, 0, sizeof(buckets_));
+    }
+private:
+    /**
+     * @brief Bucket counts of the 64 byte blocks held frames cover; guest memory accesses check these so only ones
+     * which may really touch a held frame pay for a scan
+     */
+    static constexpr size_t NumBuckets = 64;
+    [[nodiscard]] static constexpr size_t bucketOf(Address address) noexcept { return (address / RegisterFrame::Size) & (NumBuckets - 1); }
+    [[nodiscard]] bool mayHold(Address destination, size_t count) const noexcept {
+        if (count_ == 0) {
+            return false;
+        } else if (count > RegisterFrame::Size) {
+            return true;
+        } else {
+            return buckets_[bucketOf(destination)] != 0 || buckets_[bucketOf(destination + (count - 1))] != 0;
+        }
+    }
+    void mark(Address framePointer, int delta) noexcept {
+        auto first = bucketOf(framePointer);
+        auto last = bucketOf(framePointer + (RegisterFrame::Size - 1));
+        buckets_[first] += delta;
+        if (last != first) {
+            buckets_[last] += delta;
+        }
+    }
+    void release(Entry& entry) noexcept {
+        entry.valid_ = false;
+        mark(entry.framePointer_, -1);
+    }
+    template<typename Spill>
+    void evict(Entry& entry, Spill spill) noexcept {
+        if (entry.valid_) {
+            // forget it first, spill can come back around through a guest store
+            release(entry);
+            if (entry.dirty_ != 0) {
+                spill(entry.registers_, entry.framePointer_, entry.dirty_);
+            }
+        }
+    }
+    /**
+     * @brief Give back the slots at the top of the stack which no longer hold anything; only done on take since a spill
+     * can reenter the store through writeBack while it is walking the slots
+     */
+    void trimTop() noexcept {
+        while (count_ != 0 && !entries_[(top_ - 1) & EntryMask].valid_) {
+            top_ = (top_ - 1) & EntryMask;
+            --count_;
+        }
+    }
+private:
+#ifdef DESKTOP_BUILD
+    std::unique_ptr<Entry[]> storage_;
+#endif
+    Entry* entries_;
+    /**
+     * @brief Slot the next pushed frame goes in and how many slots below it are in use (holes included)
+     */
+    size_t top_ = 0;
+    size_t count_ = 0;
+    byte buckets_[NumBuckets] = { 0 };
+};
+#endif
+#endif //SIM_ECORE_FRAMESTORE_H
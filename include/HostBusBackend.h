@@ -0,0 +1,156 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SIM_ECORE_HOSTBUSBACKEND_H
+#define SIM_ECORE_HOSTBUSBACKEND_H
+#ifdef DESKTOP_BUILD
+#include <cstring>
+#include "Types.h"
+
+/**
+ * @brief Bus backend for desktop builds, the i960 physical address space is backed by a flat block of host ram. Like a partially
+ * decoded bus, addresses beyond the end of ram alias back into it.
+ */
+class HostBusBackend {
+public:
+    static constexpr size_t DefaultMemorySize = 64_MB;
+    static constexpr size_t ConfigurationSpaceSize = 4_KB;
+    /**
+     * @brief How a memory image file is attached to guest ram
+     */
+    enum class ImageMapping {
+        /**
+         * @brief Copy on write, the guest can scribble all over memory without touching the file
+         */
+        Private,
+        /**
+         * @brief Guest stores go straight back into the file
+         */
+        Shared,
+    };
+    explicit HostBusBackend(size_t size = DefaultMemorySize);
+    ~HostBusBackend();
+    HostBusBackend(const HostBusBackend&) = delete;
+    HostBusBackend& operator=(const HostBusBackend&) = delete;
+    template<typename T>
+    typename TreatAs<T>::UnderlyingType load(Address destination, TreatAs<T>) const noexcept {
+        T value;
+        std::memcpy(&value, memory_ + translate(destination), sizeof(T));
+        return value;
+    }
+    template<typename T>
+    void store(Address destination, T value, TreatAs<T>) noexcept {
+        std::memcpy(memory_ + translate(destination), &value, sizeof(T));
+    }
+    /**
+     * @brief Can the given range be moved with a single copy, only false when it wraps around the end of ram
+     */
+    [[nodiscard]] constexpr bool isContiguous(Address destination, size_t count) const noexcept {
+        return (translate(destination) + count) <= size_;
+    }
+    /**
+     * @brief All of ram is directly addressable so there are no windows to stay within
+     */
+    [[nodiscard]] static constexpr bool sameWindow(Address, Address) noexcept { return true; }
+    /**
+     * @brief Where an address really lands in ram, every alias of a byte gives the same answer
+     */
+    [[nodiscard]] constexpr Address physicalAddress(Address address) const noexcept { return static_cast<Address>(translate(address)); }
+    void loadBlock(Address destination, void* buffer, size_t count) const noexcept {
+        std::memcpy(buffer, memory_ + translate(destination), count);
+    }
+    void storeBlock(Address destination, const void* buffer, size_t count) noexcept {
+        std::memcpy(memory_ + translate(destination), buffer, count);
+    }
+    /**
+     * @brief Genuine read-modify-write on the backing memory so other cores or host threads sharing it (a shared image
+     * mapping for instance) never see a torn update. The address must be word aligned.
+     * @return The value in memory before the add
+     */
+    Ordinal atomicAdd(Address destination, Ordinal value) noexcept {
+        return __atomic_fetch_add(wordAt(destination), value, __ATOMIC_SEQ_CST);
+    }
+    /**
+     * @brief Atomically replace the bits selected by mask with those from value
+     * @return The value in memory before the modification
+     */
+    Ordinal atomicModify(Address destination, Ordinal mask, Ordinal value) noexcept {
+        auto word = wordAt(destination);
+        auto old = __atomic_load_n(word, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(word, &old, (value & mask) | (old & ~mask), false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            // old was refreshed by the failed exchange, try again
+        }
+        return old;
+    }
+    /**
+     * @brief Nothing to do on the host, the atomic operations above do not need the bus held
+     */
+    void lockBus() noexcept { }
+    void unlockBus() noexcept { }
+    [[nodiscard]] ByteOrdinal readConfigurationSpace(Address offset) const noexcept { return configurationSpace_[offset & 0xFFF]; }
+    void writeConfigurationSpace(Address offset, byte value) noexcept { configurationSpace_[offset & 0xFFF] = value; }
+public: // host only helpers
+    /**
+     * @brief Copy a block of bytes directly into the backing ram, used to install programs and data before booting
+     * @param base The i960 physical address to start copying to
+     * @param data The bytes to copy
+     * @param length The number of bytes to copy
+     */
+    void install(Address base, const void* data, size_t length) noexcept {
+        auto src = reinterpret_cast<const byte*>(data);
+        for (size_t i = 0; i < length; ++i) {
+            memory_[translate(base + i)] = src[i];
+        }
+    }
+    /**
+     * @brief Attach a raw memory image (use objcopy -O binary to flatten an ELF) as guest ram starting at base. Where the
+     * host supports it the file is mapped rather than copied, so only the pages the guest touches are ever read in
+     * @param path The image file
+     * @param base Where the image starts in the i960 physical address space, must be page aligned for the file to be mapped
+     * @param mode Whether guest stores should reach the file
+     * @return false if the file could not be opened or does not fit
+     */
+    bool mapImage(const char* path, Address base = 0, ImageMapping mode = ImageMapping::Private) noexcept;
+    /**
+     * @brief Zero all of ram and drop any attached image
+     */
+    void clear() noexcept;
+    [[nodiscard]] constexpr size_t size() const noexcept { return size_; }
+    /**
+     * @brief The host ram backing guest address zero, translated code loads and stores through it directly
+     */
+    [[nodiscard]] byte* hostMemory() const noexcept { return memory_; }
+private:
+    [[nodiscard]] constexpr size_t translate(Address address) const noexcept { return static_cast<size_t>(address) & mask_; }
+    [[nodiscard]] Ordinal* wordAt(Address address) const noexcept { return reinterpret_cast<Ordinal*>(memory_ + translate(address)); }
+private:
+    size_t size_;
+    size_t mask_;
+    /**
+     * @brief Backing ram plus a little padding at the end so a multibyte access at the last address stays in bounds
+     */
+    byte* memory_;
+    byte configurationSpace_[ConfigurationSpaceSize] = { 0 };
+};
+#endif
+#endif //SIM_ECORE_HOSTBUSBACKEND_H
@@ -80,7 +80,14 @@ constexpr auto isMEMFormat(uint8_t opcode) noexcept {
 // based off of the i960 instruction set
 struct Instruction {
 public:
-    constexpr explicit Instruction(LongOrdinal value = 0) noexcept : wholeValue_(value) { }
+    /**
+     * @brief Construct and fully decode an instruction; the operand indices, displacement, and length are resolved once
+     * here so that the handlers (and the decoded instruction cache) never need to walk the format bitfields again
+     * @param value The raw 64-bits fetched from memory, the upper 32-bits only matter for double wide MEMB instructions
+     */
+    constexpr explicit Instruction(LongOrdinal value = 0) noexcept : wholeValue_(value) {
+        decode();
+    }
     /**
      * @brief return the major opcode as an 8-bit quantity
      * @return The contents of the major opcode field without any modification
@@ -114,99 +121,68 @@ public:
     [[nodiscard]] constexpr auto isREGFormat() const noexcept { return ::isREGFormat(getMajorOpcode()); }
     [[nodiscard]] constexpr auto isCOBRFormat() const noexcept { return ::isCOBRFormat(getMajorOpcode()); }
     [[nodiscard]] constexpr auto isCTRLFormat() const noexcept { return ::isCTRLFormat(getMajorOpcode()); }
-    [[nodiscard]] constexpr Integer getDisplacement() const noexcept {
-        if (isCOBRFormat()) {
-            return cobr.displacement;
-        } else if (isCTRLFormat()) {
-            return ctrl.displacement;
-        } else if (isMEMBFormat()) {
-            return memb.optionalDisplacement;
-        } else {
-            // unsure what we should actually be returning when we have a failure
-            return -1;
-        }
-    }
+    [[nodiscard]] constexpr Integer getDisplacement() const noexcept { return displacement_; }
     [[nodiscard]] constexpr RegisterIndex getSrc1(bool ignoreM1 = false) const noexcept {
-        if (isREGFormat()) {
-            return makeRegisterIndex(reg.src1, reg.m1);
-        } else if (isCOBRFormat()) {
-            if (ignoreM1) {
-                return makeRegister(cobr.src1);
-            } else {
-                return makeRegisterIndex(cobr.src1, cobr.m1);
-            }
+        if (ignoreM1 && isCOBRFormat()) {
+            return makeRegister(cobr.src1);
         } else {
-            return RegisterIndex::Bad;
-        }
-    }
-    [[nodiscard]] constexpr RegisterIndex getSrc2() const noexcept {
-        if (isREGFormat()) {
-            return makeRegisterIndex(reg.src2, reg.m2);
-        } else if (isCOBRFormat()) {
-            return makeRegister(cobr.src2);
-        } else {
-            return RegisterIndex::Bad;
-        }
-    }
-    [[nodiscard]] constexpr RegisterIndex getSrcDest(bool treatAsSource) const noexcept {
-        if (isREGFormat()) {
-            return makeRegisterIndex(reg.srcDest, treatAsSource ? static_cast<bool>(reg.m3) : false);
-        } else if (isMEMFormat()) {
-            return makeRegister(mem.srcDest);
-        } else {
-            return RegisterIndex::Bad;
+            return src1_;
         }
     }
+    [[nodiscard]] constexpr RegisterIndex getSrc2() const noexcept { return src2_; }
+    [[nodiscard]] constexpr RegisterIndex getSrcDest(bool treatAsSource) const noexcept { return treatAsSource ? srcDestSource_ : srcDestDestination_; }
     [[nodiscard]] constexpr Ordinal getOffset() const noexcept {
         if (isMEMAFormat()) {
-            return mema.offset;
+            return static_cast<Ordinal>(displacement_);
         } else {
             return 0xFFFF'FFFF;
         }
     }
-    [[nodiscard]] constexpr RegisterIndex getABase() const noexcept {
-        if (isMEMFormat()) {
-            return makeRegister(mem.abase);
-        } else {
-            return RegisterIndex::Bad;
-        }
-    }
-
-    [[nodiscard]] constexpr MEMFormatMode getMemFormatMode() const noexcept {
-        if (isMEMAFormat()) {
-            return mema.mode == 0 ? MEMFormatMode::MEMA_AbsoluteOffset : MEMFormatMode::MEMA_RegisterIndirectWithOffset;
-        } else if (isMEMBFormat()) {
-            return static_cast<MEMFormatMode>(memb.mode);
-        } else {
-            return MEMFormatMode::Bad;
-        }
-    }
-    [[nodiscard]] constexpr RegisterIndex getIndex() const noexcept {
-        if (isMEMBFormat()) {
-            return makeRegister(memb.index);
-        } else {
-            return RegisterIndex::Bad;
-        }
-    }
-    [[nodiscard]] constexpr uint8_t getScale() const noexcept {
-        if (isMEMBFormat()) {
-            return memb.scale; // this is already setup for proper shifting
-        } else {
-            return 0;
-        }
-    }
-    [[nodiscard]] constexpr auto isDoubleWide() const noexcept {
-        // if it is not a MEM instruction then we still get Bad out which
-        // is legal and returns false
-        return isDoubleWideInstruction(getMemFormatMode());
-    }
+    [[nodiscard]] constexpr RegisterIndex getABase() const noexcept { return abase_; }
+    [[nodiscard]] constexpr MEMFormatMode getMemFormatMode() const noexcept { return memFormatMode_; }
+    [[nodiscard]] constexpr RegisterIndex getIndex() const noexcept { return index_; }
+    [[nodiscard]] constexpr uint8_t getScale() const noexcept { return scale_; }
+    [[nodiscard]] constexpr auto isDoubleWide() const noexcept { return length_ == 8; }
+    /**
+     * @brief The number of bytes this instruction occupies in memory
+     * @return 8 for double wide MEMB instructions and 4 for everything else
+     */
+    [[nodiscard]] constexpr uint8_t getLength() const noexcept { return length_; }
 
 private:
     [[nodiscard]] constexpr bool isMEMAFormat() const noexcept {
-        return isMEMFormat() && ((mem.modeMajor & 1u) == 0);
+        return memFormatMode_ == MEMFormatMode::MEMA_AbsoluteOffset || memFormatMode_ == MEMFormatMode::MEMA_RegisterIndirectWithOffset;
     }
-    [[nodiscard]] constexpr bool isMEMBFormat() const noexcept {
-        return isMEMFormat() && ((mem.modeMajor & 1u) != 0);
+    constexpr void decode() noexcept {
+        if (isREGFormat()) {
+            src1_ = makeRegisterIndex(reg.src1, reg.m1);
+            src2_ = makeRegisterIndex(reg.src2, reg.m2);
+            srcDestSource_ = makeRegisterIndex(reg.srcDest, reg.m3);
+            srcDestDestination_ = makeRegister(reg.srcDest);
+        } else if (isCOBRFormat()) {
+            src1_ = makeRegisterIndex(cobr.src1, cobr.m1);
+            src2_ = makeRegister(cobr.src2);
+            displacement_ = cobr.displacement;
+        } else if (isCTRLFormat()) {
+            displacement_ = ctrl.displacement;
+        } else if (isMEMFormat()) {
+            srcDestSource_ = makeRegister(mem.srcDest);
+            srcDestDestination_ = srcDestSource_;
+            abase_ = makeRegister(mem.abase);
+            if ((mem.modeMajor & 1u) == 0) {
+                // MEMA, the offset lives where a MEMB displacement would; an instruction can only ever have one of them
+                memFormatMode_ = mema.mode == 0 ? MEMFormatMode::MEMA_AbsoluteOffset : MEMFormatMode::MEMA_RegisterIndirectWithOffset;
+                displacement_ = static_cast<Integer>(mema.offset);
+            } else {
+                memFormatMode_ = static_cast<MEMFormatMode>(memb.mode);
+                index_ = makeRegister(memb.index);
+                scale_ = memb.scale; // this is already setup for proper shifting
+                displacement_ = memb.optionalDisplacement;
+                if (isDoubleWideInstruction(memFormatMode_)) {
+                    length_ = 8;
+                }
+            }
+        }
     }
 private:
     union
@@ -276,5 +252,16 @@ private:
         } memb;
         LongOrdinal wholeValue_;
     };
+    // decoded fields, everything not applicable to the instruction's format is left as Bad/zero
+    Integer displacement_ = -1;
+    RegisterIndex src1_ = RegisterIndex::Bad;
+    RegisterIndex src2_ = RegisterIndex::Bad;
+    RegisterIndex srcDestSource_ = RegisterIndex::Bad;
+    RegisterIndex srcDestDestination_ = RegisterIndex::Bad;
+    RegisterIndex abase_ = RegisterIndex::Bad;
+    RegisterIndex index_ = RegisterIndex::Bad;
+    uint8_t scale_ = 0;
+    MEMFormatMode memFormatMode_ = MEMFormatMode::Bad;
+    uint8_t length_ = 4;
 };
 #endif //SIM3_INSTRUCTION_H
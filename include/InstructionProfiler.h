@@ -0,0 +1,104 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// Per instruction execution counts and (optionally) handler timing. Everything in here is compiled out unless
+// PROFILE_INSTRUCTIONS is defined; PROFILE_INSTRUCTION_TIMING additionally samples a cycle counter around each handler.
+#ifndef SIM_ECORE_INSTRUCTIONPROFILER_H
+#define SIM_ECORE_INSTRUCTIONPROFILER_H
+#ifdef PROFILE_INSTRUCTIONS
+#include "Types.h"
+#ifdef PROFILE_INSTRUCTION_TIMING
+#if defined(ARDUINO)
+#include <Arduino.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+/**
+ * @brief Counters indexed by Core::DispatchIndex
+ * @tparam NumEntries The number of dispatch indices
+ */
+template<size_t NumEntries>
+class InstructionProfiler {
+public:
+    /**
+     * @brief Cycles on the AVR (timer 1 running at F_CPU), TSC ticks on x86 hosts and nanoseconds everywhere else
+     */
+    using Timestamp = LongOrdinal;
+    static constexpr size_t Size = NumEntries;
+public:
+    /**
+     * @brief Start whatever counter the timing samples come from
+     */
+    static void begin() noexcept {
+#if defined(PROFILE_INSTRUCTION_TIMING) && defined(ARDUINO)
+        // timer 0 belongs to millis() so use timer 1 free running with no prescaler
+        TCCR1A = 0;
+        TCCR1B = _BV(CS10);
+        TCCR1C = 0;
+#endif
+    }
+    [[nodiscard]] static Timestamp now() noexcept {
+#ifndef PROFILE_INSTRUCTION_TIMING
+        return 0;
+#elif defined(ARDUINO)
+        return TCNT1;
+#elif defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+    void record(size_t index, [[maybe_unused]] Timestamp start) noexcept {
+        ++counts_[index];
+#ifdef PROFILE_INSTRUCTION_TIMING
+#ifdef ARDUINO
+        // timer 1 is only 16 bits wide, unsigned subtraction takes care of a single wrap
+        elapsed_[index] += static_cast<uint16_t>(static_cast<uint16_t>(TCNT1) - static_cast<uint16_t>(start));
+#else
+        elapsed_[index] += now() - start;
+#endif
+#endif
+    }
+    void clear() noexcept {
+        for (size_t i = 0; i < NumEntries; ++i) {
+            counts_[i] = 0;
+#ifdef PROFILE_INSTRUCTION_TIMING
+            elapsed_[i] = 0;
+#endif
+        }
+    }
+    [[nodiscard]] Ordinal getCount(size_t index) const noexcept { return index < NumEntries ? counts_[index] : 0; }
+    [[nodiscard]] Timestamp getElapsed(size_t index) const noexcept { return index < NumEntries ? elapsed_[index] : 0; }
+private:
+    Ordinal counts_[NumEntries] = { 0 };
+#ifdef PROFILE_INSTRUCTION_TIMING
+    Timestamp elapsed_[NumEntries] = { 0 };
+#else
+    static constexpr Timestamp elapsed_[NumEntries] = { 0 };
+#endif
+};
+#endif
+#endif //SIM_ECORE_INSTRUCTIONPROFILER_H
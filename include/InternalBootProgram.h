@@ -27,6 +27,10 @@
 
 #ifndef SIM_ECORE_INTERNALBOOTPROGRAM_H
 #define SIM_ECORE_INTERNALBOOTPROGRAM_H
-#include <Arduino.h>
+#include "Types.h"
 uint8_t readFromInternalBootProgram(size_t index) noexcept;
+/**
+ * @brief Copy count bytes of the boot program starting at index, anything past the end reads as zero
+ */
+void readFromInternalBootProgram(size_t index, void* buffer, size_t count) noexcept;
 #endif //SIM_ECORE_INTERNALBOOTPROGRAM_H
@@ -0,0 +1,216 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#ifndef SIM_ECORE_STACKCACHE_H
+#define SIM_ECORE_STACKCACHE_H
+#ifdef STACK_CACHE
+#if defined(DATA_CACHE) || defined(STORE_BUFFER)
+#error "STACK_CACHE takes the place of the data cache and the store buffer, only define one of them"
+#endif
+#include <string.h>
+#include "BusBackend.h"
+
+/**
+ * @brief Write back cache of the stretch of stack around the frame pointer, held in the microcontroller's own sram.
+ * Register spills and fills, pfp/rip accesses and stack variables all land close to fp so a small window which slides
+ * with call depth catches most of them without touching the bank switched external bus. Everything outside the window
+ * goes straight to the bus. Lines sit in the buffer at their address modulo its size, so sliding the window by a line
+ * only evicts that line and never moves anything else.
+ */
+class StackCache {
+public:
+#ifdef DESKTOP_BUILD
+    static constexpr size_t Size = 2048;
+#else
+    static constexpr size_t Size = 512;
+#endif
+    /**
+     * @brief One register frame
+     */
+    static constexpr size_t LineSize = 64;
+    static constexpr size_t NumLines = Size / LineSize;
+    static_assert((Size & (Size - 1)) == 0, "The stack cache size must be a power of two");
+    static_assert(NumLines <= 32, "Line state is kept in 32 bit masks");
+    /**
+     * @brief How much of the window is kept above the frame pointer: the current frame plus the stack variables after it
+     */
+    static constexpr size_t Headroom = Size / 4;
+    template<typename T>
+    T load(BusBackend& bus, Address destination) noexcept {
+        if (auto offset = destination & (LineSize - 1); covers(destination, sizeof(T)) && (offset + sizeof(T)) <= LineSize) {
+            T value;
+            memcpy(&value, lineFor(bus, destination), sizeof(T));
+            return value;
+        }
+        writeBack(bus, destination, sizeof(T));
+        return bus.load(destination, TreatAs<T>{});
+    }
+    template<typename T>
+    void store(BusBackend& bus, Address destination, T value) noexcept {
+        if (auto offset = destination & (LineSize - 1); covers(destination, sizeof(T)) && (offset + sizeof(T)) <= LineSize) {
+            memcpy(lineFor(bus, destination), &value, sizeof(T));
+            dirty_ |= lineBit(destination);
+            return;
+        }
+        flush(bus, destination, sizeof(T));
+        bus.store(destination, value, TreatAs<T>{});
+    }
+    void loadBlock(BusBackend& bus, Address destination, void* buffer, size_t count) noexcept {
+        if (!covers(destination, count)) {
+            writeBack(bus, destination, count);
+            bus.loadBlock(destination, buffer, count);
+            return;
+        }
+        auto bytes = reinterpret_cast<byte*>(buffer);
+        while (count != 0) {
+            auto amount = lineRemaining(destination, count);
+            memcpy(bytes, lineFor(bus, destination), amount);
+            bytes += amount;
+            destination += amount;
+            count -= amount;
+        }
+    }
+    void storeBlock(BusBackend& bus, Address destination, const void* buffer, size_t count) noexcept {
+        if (!covers(destination, count)) {
+            flush(bus, destination, count);
+            bus.storeBlock(destination, buffer, count);
+            return;
+        }
+        auto bytes = reinterpret_cast<const byte*>(buffer);
+        while (count != 0) {
+            auto amount = lineRemaining(destination, count);
+            auto bit = lineBit(destination);
+            if (amount == LineSize) {
+                // the whole line is being replaced, no point in reading it first
+                valid_ |= bit;
+            }
+            memcpy(lineFor(bus, destination), bytes, amount);
+            dirty_ |= bit;
+            bytes += amount;
+            destination += amount;
+            count -= amount;
+        }
+    }
+    /**
+     * @brief Keep the window around the given frame pointer. Nothing happens while fp stays in the upper middle of the
+     * window; otherwise it is moved so fp sits Headroom below the top again, and only the lines which fall off the end
+     * are written back
+     */
+    void follow(BusBackend& bus, Address framePointer) noexcept {
+        auto line = framePointer & ~static_cast<Address>(LineSize - 1);
+        if (auto offset = line - base_; offset >= (Size / 2) && offset <= (Size - Headroom)) {
+            return;
+        }
+        Address newBase = line + Headroom - Size;
+        for (size_t i = 0; i < NumLines; ++i) {
+            if (auto address = base_ + (i * LineSize); (address - newBase) >= Size) {
+                evict(bus, address);
+            }
+        }
+        base_ = newBase;
+    }
+    /**
+     * @brief Write every dirty line back to the bus but keep them all cached
+     */
+    void writeBack(BusBackend& bus) noexcept {
+        for (size_t i = 0; dirty_ != 0 && i < NumLines; ++i) {
+            writeBackLine(bus, base_ + (i * LineSize));
+        }
+    }
+    /**
+     * @brief Write back every dirty line and then forget the contents of the whole window
+     */
+    void flush(BusBackend& bus) noexcept {
+        writeBack(bus);
+        valid_ = 0;
+    }
+    /**
+     * @brief Write back only the lines which overlap the given range, they stay cached
+     */
+    void writeBack(BusBackend& bus, Address destination, size_t count) noexcept {
+        if (overlaps(destination, count)) {
+            forEachLineIn(destination, count, [this, &bus](Address line) noexcept { writeBackLine(bus, line); });
+        }
+    }
+    /**
+     * @brief Write back and forget only the lines which overlap the given range, used before the bus is accessed directly
+     */
+    void flush(BusBackend& bus, Address destination, size_t count) noexcept {
+        if (overlaps(destination, count)) {
+            forEachLineIn(destination, count, [this, &bus](Address line) noexcept { evict(bus, line); });
+        }
+    }
+private:
+    [[nodiscard]] bool covers(Address destination, size_t count) const noexcept {
+        return count <= Size && (destination - base_) <= (Size - count);
+    }
+    [[nodiscard]] bool overlaps(Address destination, size_t count) const noexcept {
+        return (destination - base_) < Size || (base_ - destination) < count;
+    }
+    [[nodiscard]] static constexpr size_t lineRemaining(Address destination, size_t count) noexcept {
+        auto available = LineSize - (destination & (LineSize - 1));
+        return count < available ? count : available;
+    }
+    [[nodiscard]] static constexpr uint32_t lineBit(Address destination) noexcept {
+        return static_cast<uint32_t>(1) << ((destination / LineSize) & (NumLines - 1));
+    }
+    [[nodiscard]] byte* slotFor(Address destination) noexcept { return data_ + (destination & (Size - 1)); }
+    /**
+     * @brief Where the given byte of the window lives, reading its line in from the bus the first time it is touched
+     */
+    byte* lineFor(BusBackend& bus, Address destination) noexcept {
+        if (auto bit = lineBit(destination); (valid_ & bit) == 0) {
+            auto line = destination & ~static_cast<Address>(LineSize - 1);
+            bus.loadBlock(line, slotFor(line), LineSize);
+            valid_ |= bit;
+        }
+        return slotFor(destination);
+    }
+    void writeBackLine(BusBackend& bus, Address line) noexcept {
+        if (auto bit = lineBit(line); (valid_ & dirty_ & bit) != 0) {
+            bus.storeBlock(line, slotFor(line), LineSize);
+            dirty_ &= ~bit;
+        }
+    }
+    void evict(BusBackend& bus, Address line) noexcept {
+        writeBackLine(bus, line);
+        valid_ &= ~lineBit(line);
+    }
+    template<typename Action>
+    void forEachLineIn(Address destination, size_t count, Action action) noexcept {
+        for (size_t i = 0; i < NumLines; ++i) {
+            if (auto line = base_ + (i * LineSize); (line - destination) < count || (destination - line) < LineSize) {
+                action(line);
+            }
+        }
+    }
+private:
+    /**
+     * @brief Lowest address in the window, always line aligned
+     */
+    Address base_ = 0;
+    uint32_t valid_ = 0;
+    uint32_t dirty_ = 0;
+    byte data_[Size];
+};
+#endif
+#endif //SIM_ECORE_STACKCACHE_H
@@ -0,0 +1,107 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#ifndef SIM_ECORE_STOREBUFFER_H
+#define SIM_ECORE_STOREBUFFER_H
+#ifdef STORE_BUFFER
+#ifdef DATA_CACHE
+#error "The data cache already combines stores, STORE_BUFFER is for builds without it"
+#endif
+#include <string.h>
+#include "BusBackend.h"
+
+/**
+ * @brief Write combining buffer between the core and the bus backend. Stores to adjacent (or already buffered) bytes in
+ * the same bus window are collected and handed to the bus as one block, so a loop filling a buffer pays for the window
+ * check and address setup once per Capacity bytes instead of once per store. Anything which could observe the pending
+ * bytes out of order drains it first. The run is kept by physical address (after the backend folds aliases together) so
+ * an access through an alias of a pending byte still sees it, and a run never wraps around the end of ram.
+ */
+class StoreBuffer {
+public:
+    static constexpr size_t Capacity = 32;
+    template<typename T>
+    T load(BusBackend& bus, Address destination) noexcept {
+        drain(bus, destination, sizeof(T));
+        return bus.load(destination, TreatAs<T>{});
+    }
+    template<typename T>
+    void store(BusBackend& bus, Address destination, T value) noexcept {
+        storeBlock(bus, destination, &value, sizeof(T));
+    }
+    void loadBlock(BusBackend& bus, Address destination, void* buffer, size_t count) noexcept {
+        drain(bus, destination, count);
+        bus.loadBlock(destination, buffer, count);
+    }
+    void storeBlock(BusBackend& bus, Address destination, const void* buffer, size_t count) noexcept {
+        auto physical = bus.physicalAddress(destination);
+        if (count_ != 0) {
+            if (physical >= start_ && (physical - start_) <= count_) {
+                // overwrites buffered bytes and/or extends the run
+                auto offset = physical - start_;
+                if (auto end = offset + count; end <= Capacity && bus.isContiguous(start_, end) &&
+                                               BusBackend::sameWindow(start_, physical + (count - 1))) {
+                    memcpy(data_ + offset, buffer, count);
+                    if (end > count_) {
+                        count_ = end;
+                    }
+                    return;
+                }
+            }
+            drain(bus);
+        }
+        if (count > Capacity || !bus.isContiguous(physical, count)) {
+            bus.storeBlock(destination, buffer, count);
+        } else {
+            start_ = physical;
+            count_ = count;
+            memcpy(data_, buffer, count);
+        }
+    }
+    /**
+     * @brief Hand everything pending to the bus
+     */
+    void drain(BusBackend& bus) noexcept {
+        if (count_ != 0) {
+            bus.storeBlock(start_, data_, count_);
+            count_ = 0;
+        }
+    }
+    /**
+     * @brief Drain only if the pending bytes overlap the given range
+     */
+    void drain(BusBackend& bus, Address destination, size_t count) noexcept {
+        if (count_ != 0) {
+            // a range which wraps around the end of ram is not worth working out, just drain
+            if (auto physical = bus.physicalAddress(destination); !bus.isContiguous(physical, count) ||
+                                                                  (physical - start_) < count_ || (start_ - physical) < count) {
+                drain(bus);
+            }
+        }
+    }
+private:
+    Address start_ = 0;
+    size_t count_ = 0;
+    byte data_[Capacity];
+};
+#endif
+#endif //SIM_ECORE_STOREBUFFER_H
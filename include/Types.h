@@ -28,6 +28,7 @@
 #define SIM3_TYPES_H
 #ifdef DESKTOP_BUILD
 #include <cstdint>
+#include "DesktopArduino.h"
 #endif
 #ifdef ARDUINO
 #include <Arduino.h>
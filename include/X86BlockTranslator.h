@@ -0,0 +1,173 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// A tiny x86-64 code emitter used by the host build to translate hot basic blocks into native code.
+//
+#ifndef SIM_ECORE_X86BLOCKTRANSLATOR_H
+#define SIM_ECORE_X86BLOCKTRANSLATOR_H
+#ifdef HOST_JIT
+#if !defined(DESKTOP_BUILD) || !defined(__x86_64__)
+#error "HOST_JIT is only supported by x86-64 desktop builds"
+#endif
+#include "Types.h"
+#include "Register.h"
+
+/**
+ * @brief Owns an executable arena and knows just enough x86-64 to emit straight line register to register code and
+ * guarded accesses to host ram. The generated function keeps the core in rbx, pointers to the current locals in r12, the
+ * globals in r13, the ip in r14 and the start of host ram in r15. eax and ecx hold operands, edx is only used for address
+ * checks and shifts.
+ */
+class X86BlockTranslator {
+public:
+    /**
+     * @brief Signature of a translated block
+     * @return The number of i960 instructions which were executed before leaving the block
+     */
+    using Entry = Ordinal (*)(void* core, Register* locals, Register* globals, Register* ip, byte* memory);
+    /**
+     * @brief Signature of the function called to execute an instruction the translator has no native form for
+     * @return true if execution should continue with the next instruction in the block
+     */
+    using Fallback = bool (*)(void* core, const void* instruction, Ordinal dispatch, Address address, void* block, Address blockAddress);
+    enum class Base : byte {
+        Locals,
+        Globals,
+    };
+    enum class Scratch : byte {
+        EAX,
+        ECX,
+    };
+    enum class Operation : byte {
+        Add,
+        Subtract,
+        Multiply,
+        And,
+        Or,
+        Xor,
+    };
+    /**
+     * @brief Everything a guarded memory access has to check before it can go straight to host ram; the three offsets are
+     * from the start of the core object (rbx) so the values are always read fresh
+     */
+    struct AccessGuard {
+        /**
+         * @brief Accesses have to end below this to be plain ram (no aliasing, no internal space)
+         */
+        Ordinal limit_;
+        /**
+         * @brief The stale frame has to be written back before its 64 bytes of stack are touched
+         */
+        int32_t staleFramePointer_;
+        /**
+         * @brief Bounds of the decoded instructions, stores inside them have to invalidate
+         */
+        int32_t codeLowest_;
+        int32_t codeHighest_;
+    };
+    /**
+     * @brief Jumps emitted before their target is known, bind points all of them at the current position
+     */
+    struct ForwardJumps {
+        size_t sites_[4] = { 0 };
+        byte count_ = 0;
+    };
+    static constexpr size_t ArenaSize = 8_MB;
+    /**
+     * @brief The most bytes a single i960 instruction can expand into, used to make sure a block will fit before starting it
+     */
+    static constexpr size_t MaxBytesPerInstruction = 192;
+public:
+    X86BlockTranslator() noexcept;
+    ~X86BlockTranslator();
+    X86BlockTranslator(const X86BlockTranslator&) = delete;
+    X86BlockTranslator& operator=(const X86BlockTranslator&) = delete;
+    [[nodiscard]] bool available() const noexcept { return arena_ != nullptr; }
+    [[nodiscard]] bool hasRoomFor(size_t instructionCount) const noexcept {
+        return available() && (ArenaSize - position_) >= ((instructionCount + 2) * MaxBytesPerInstruction);
+    }
+    /**
+     * @brief Throw away every translation made so far
+     */
+    void reset() noexcept { position_ = 0; }
+    /**
+     * @brief Start a new translated block, emits the prologue
+     * @return The entry point of the new block
+     */
+    Entry begin() noexcept;
+    /**
+     * @brief Throw away a block started with begin, it was not worth translating
+     */
+    void abandon(Entry entry) noexcept { position_ = reinterpret_cast<byte*>(entry) - arena_; }
+    void loadRegister(Scratch dest, Base base, byte index) noexcept;
+    void loadImmediate(Scratch dest, Ordinal value) noexcept;
+    void storeRegister(Base base, byte index) noexcept;
+    /**
+     * @brief eax = eax op ecx
+     */
+    void combine(Operation op) noexcept;
+    void invert(Scratch target) noexcept;
+    /**
+     * @brief eax = ecx < 32 ? eax shifted by ecx : 0; the i960 semantics for shlo and shro
+     */
+    void shift(bool left) noexcept;
+    void shiftLeft(Scratch target, byte amount) noexcept;
+    /**
+     * @brief Jump to slow unless the width bytes at the address in eax are plain ram which nothing else is watching;
+     * stores also have to stay clear of decoded code
+     */
+    void guardAccess(const AccessGuard& guard, byte width, bool store, ForwardJumps& slow) noexcept;
+    /**
+     * @brief eax = the zero extended width bytes of host ram at eax
+     */
+    void loadMemory(byte width) noexcept;
+    /**
+     * @brief Write the low width bytes of ecx to host ram at eax
+     */
+    void storeMemory(byte width) noexcept;
+    void jumpForward(ForwardJumps& jumps) noexcept;
+    void bind(ForwardJumps& jumps) noexcept;
+    /**
+     * @brief Call back into the interpreter for a single instruction and leave the block if it says to
+     * @param executedSoFar The number of instructions executed once this one has been, returned if the block is left here
+     */
+    void fallback(Fallback function, void* core, const void* instruction, Ordinal dispatch, Address address, void* block, Address blockAddress, Ordinal executedSoFar) noexcept;
+    /**
+     * @brief Store the next ip and leave the block
+     */
+    void finish(Address nextIP, Ordinal executed) noexcept;
+private:
+    void emit(byte value) noexcept { arena_[position_++] = value; }
+    template<typename T>
+    void emitValue(T value) noexcept {
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            emit(static_cast<byte>(static_cast<LongOrdinal>(value) >> (i * 8)));
+        }
+    }
+    void emitReturn(Ordinal executed) noexcept;
+private:
+    byte* arena_ = nullptr;
+    size_t position_ = 0;
+};
+#endif
+#endif //SIM_ECORE_X86BLOCKTRANSLATOR_H
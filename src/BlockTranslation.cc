@@ -0,0 +1,355 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Host only: turn hot basic blocks into native x86-64 code
+//
+#ifdef HOST_JIT
+#include <algorithm>
+#include "Core.h"
+
+namespace {
+    using Scratch = X86BlockTranslator::Scratch;
+    using Base = X86BlockTranslator::Base;
+    using Operation = X86BlockTranslator::Operation;
+    /**
+     * @brief Loads and stores can only go straight to host ram when there is nothing (data cache, store buffer, stack
+     * cache or frame store) holding a newer copy of it
+     */
+#if defined(DATA_CACHE) || defined(STORE_BUFFER) || defined(STACK_CACHE) || defined(FRAME_STORE)
+    constexpr bool AccessesHostMemoryDirectly = false;
+#else
+    constexpr bool AccessesHostMemoryDirectly = true;
+#endif
+    /**
+     * @brief Internal space starts here (see Core::inInternalSpace), it never goes to ram
+     */
+    constexpr Address InternalSpaceStart = 0xFF00'0000;
+    void
+    loadOperand(X86BlockTranslator& emitter, Scratch dest, RegisterIndex index) noexcept {
+        if (isLiteral(index)) {
+            emitter.loadImmediate(dest, getLiteral(index, TreatAsOrdinal{}));
+        } else {
+            emitter.loadRegister(dest, isLocalRegister(index) ? Base::Locals : Base::Globals, static_cast<byte>(index) & 0b1111);
+        }
+    }
+    void
+    storeResult(X86BlockTranslator& emitter, RegisterIndex index) noexcept {
+        emitter.storeRegister(isLocalRegister(index) ? Base::Locals : Base::Globals, static_cast<byte>(index) & 0b1111);
+    }
+    /**
+     * @brief eax = src2, ecx = src1 which is the operand order every REG format arithmetic instruction uses
+     */
+    void
+    loadSources(X86BlockTranslator& emitter, const Instruction& instruction) noexcept {
+        loadOperand(emitter, Scratch::EAX, instruction.getSrc2());
+        loadOperand(emitter, Scratch::ECX, instruction.getSrc1());
+    }
+    /**
+     * @brief eax = the effective address of a MEM format instruction, the same computation as Core::computeMemoryAddress
+     * @param address Where the instruction itself lives, ip relative addresses are constants once it is known
+     * @return false (having emitted nothing) for encodings which are not valid addressing modes
+     */
+    bool
+    computeAddress(X86BlockTranslator& emitter, const Instruction& instruction, Address address) noexcept {
+        auto addIndex = [&emitter, &instruction]() noexcept {
+            loadOperand(emitter, Scratch::ECX, instruction.getIndex());
+            emitter.shiftLeft(Scratch::ECX, instruction.getScale());
+            emitter.combine(Operation::Add);
+        };
+        auto addDisplacement = [&emitter, &instruction]() noexcept {
+            emitter.loadImmediate(Scratch::ECX, static_cast<Ordinal>(instruction.getDisplacement()));
+            emitter.combine(Operation::Add);
+        };
+        switch (instruction.getMemFormatMode()) {
+            case MEMFormatMode::MEMA_AbsoluteOffset:
+                emitter.loadImmediate(Scratch::EAX, instruction.getOffset());
+                break;
+            case MEMFormatMode::MEMA_RegisterIndirectWithOffset:
+                loadOperand(emitter, Scratch::EAX, instruction.getABase());
+                emitter.loadImmediate(Scratch::ECX, instruction.getOffset());
+                emitter.combine(Operation::Add);
+                break;
+            case MEMFormatMode::MEMB_RegisterIndirect:
+                loadOperand(emitter, Scratch::EAX, instruction.getABase());
+                break;
+            case MEMFormatMode::MEMB_RegisterIndirectWithIndex:
+                loadOperand(emitter, Scratch::EAX, instruction.getABase());
+                addIndex();
+                break;
+            case MEMFormatMode::MEMB_IPWithDisplacement:
+                emitter.loadImmediate(Scratch::EAX, static_cast<Ordinal>(address + instruction.getDisplacement() + 8));
+                break;
+            case MEMFormatMode::MEMB_AbsoluteDisplacement:
+                emitter.loadImmediate(Scratch::EAX, static_cast<Ordinal>(instruction.getDisplacement()));
+                break;
+            case MEMFormatMode::MEMB_RegisterIndirectWithDisplacement:
+                loadOperand(emitter, Scratch::EAX, instruction.getABase());
+                addDisplacement();
+                break;
+            case MEMFormatMode::MEMB_IndexWithDisplacement:
+                loadOperand(emitter, Scratch::EAX, instruction.getIndex());
+                emitter.shiftLeft(Scratch::EAX, instruction.getScale());
+                addDisplacement();
+                break;
+            case MEMFormatMode::MEMB_RegisterIndirectWithIndexAndDisplacement:
+                loadOperand(emitter, Scratch::EAX, instruction.getABase());
+                addIndex();
+                addDisplacement();
+                break;
+            default:
+                return false;
+        }
+        return true;
+    }
+    /**
+     * @return The number of bytes moved by the loads and stores which have a native form, zero for everything else
+     */
+    byte
+    accessWidth(Core::DispatchIndex index) noexcept {
+        using K = Core::DispatchIndex;
+        switch (index) {
+            case K::ldob:
+            case K::stob:
+                return 1;
+            case K::ldos:
+            case K::stos:
+                return 2;
+            case K::ld:
+            case K::st:
+                return 4;
+            default:
+                return 0;
+        }
+    }
+    bool
+    isStore(Core::DispatchIndex index) noexcept {
+        using K = Core::DispatchIndex;
+        return index == K::stob || index == K::stos || index == K::st;
+    }
+    /**
+     * @brief Emit a load or store which goes straight to host ram when the guard allows it and otherwise calls slowPath to
+     * run the instruction in the interpreter
+     * @return false if the instruction is not a load or store this can handle, nothing has been emitted in that case
+     */
+    template<typename SlowPath>
+    bool
+    translateAccess(X86BlockTranslator& emitter, const X86BlockTranslator::AccessGuard& guard, Core::DispatchIndex index, const Instruction& instruction, Address address, SlowPath slowPath) noexcept {
+        auto width = accessWidth(index);
+        if (!AccessesHostMemoryDirectly || width == 0 || !isRegister(instruction.getSrcDest(false))) {
+            return false;
+        }
+        if (!computeAddress(emitter, instruction, address)) {
+            return false;
+        }
+        X86BlockTranslator::ForwardJumps slow;
+        X86BlockTranslator::ForwardJumps done;
+        auto store = isStore(index);
+        emitter.guardAccess(guard, width, store, slow);
+        if (store) {
+            loadOperand(emitter, Scratch::ECX, instruction.getSrcDest(true));
+            emitter.storeMemory(width);
+        } else {
+            emitter.loadMemory(width);
+            storeResult(emitter, instruction.getSrcDest(false));
+        }
+        emitter.jumpForward(done);
+        emitter.bind(slow);
+        slowPath();
+        emitter.bind(done);
+        return true;
+    }
+    /**
+     * @brief Emit native code for the given instruction if it only touches registers
+     * @return false if the instruction has to go through the interpreter instead
+     */
+    bool
+    translateInline(X86BlockTranslator& emitter, Core::DispatchIndex index, const Instruction& instruction, Address address) noexcept {
+        using K = Core::DispatchIndex;
+        auto destination = instruction.getSrcDest(false);
+        if (!isRegister(destination)) {
+            return false;
+        }
+        if (index == K::lda) {
+            if (!computeAddress(emitter, instruction, address)) {
+                return false;
+            }
+            storeResult(emitter, destination);
+            return true;
+        }
+        switch (index) {
+            case K::mov:
+                loadOperand(emitter, Scratch::EAX, instruction.getSrc1());
+                break;
+            case K::logicalNot:
+                loadOperand(emitter, Scratch::EAX, instruction.getSrc1());
+                emitter.invert(Scratch::EAX);
+                break;
+            // integer overflow faults are not implemented by the interpreter so the signed forms are the same operation
+            case K::addo:
+            case K::addi:
+                loadSources(emitter, instruction);
+                emitter.combine(Operation::Add);
+                break;
+            case K::subo:
+            case K::subi:
+                loadSources(emitter, instruction);
+                emitter.combine(Operation::Subtract);
+                break;
+            case K::mulo:
+            case K::muli:
+                loadSources(emitter, instruction);
+                emitter.combine(Operation::Multiply);
+                break;
+            case K::logicalAnd:
+            case K::logicalNand:
+                loadSources(emitter, instruction);
+                emitter.combine(Operation::And);
+                if (index == K::logicalNand) {
+                    emitter.invert(Scratch::EAX);
+                }
+                break;
+            case K::logicalOr:
+            case K::logicalNor:
+                loadSources(emitter, instruction);
+                emitter.combine(Operation::Or);
+                if (index == K::logicalNor) {
+                    emitter.invert(Scratch::EAX);
+                }
+                break;
+            case K::logicalXor:
+            case K::logicalXnor:
+                loadSources(emitter, instruction);
+                emitter.combine(Operation::Xor);
+                if (index == K::logicalXnor) {
+                    emitter.invert(Scratch::EAX);
+                }
+                break;
+            case K::andnot:
+                loadSources(emitter, instruction);
+                emitter.invert(Scratch::ECX);
+                emitter.combine(Operation::And);
+                break;
+            case K::notand:
+                loadSources(emitter, instruction);
+                emitter.invert(Scratch::EAX);
+                emitter.combine(Operation::And);
+                break;
+            case K::ornot:
+                loadSources(emitter, instruction);
+                emitter.invert(Scratch::ECX);
+                emitter.combine(Operation::Or);
+                break;
+            case K::notor:
+                loadSources(emitter, instruction);
+                emitter.invert(Scratch::EAX);
+                emitter.combine(Operation::Or);
+                break;
+            case K::shlo:
+            case K::shro:
+                loadSources(emitter, instruction);
+                emitter.shift(index == K::shlo);
+                break;
+            default:
+                return false;
+        }
+        storeResult(emitter, destination);
+        return true;
+    }
+}
+
+bool
+Core::jitFallback(void* core, const void* instruction, Ordinal dispatch, Address address, void* block, Address blockAddress) noexcept {
+    auto& self = *reinterpret_cast<Core*>(core);
+    auto& theBlock = *reinterpret_cast<DecodedBlock*>(block);
+    const auto& theInstruction = *reinterpret_cast<const Instruction*>(instruction);
+    auto frameIndex = self.currentFrameIndex_;
+    self.ip_.set<Ordinal>(address);
+    self.advanceIPBy = theInstruction.getLength();
+    self.executeInstruction(static_cast<DispatchIndex>(dispatch), theInstruction);
+    if (self.advanceIPBy == 0) {
+        return false;
+    }
+    self.ip_.set<Ordinal>(address + self.advanceIPBy);
+    // the translated code has the locals pointer baked in and the instruction pointers point into the block
+    return theBlock.address_ == blockAddress && self.currentFrameIndex_ == frameIndex;
+}
+
+void
+Core::translateBlock(DecodedBlock& block) noexcept {
+    if (!translator_.available()) {
+        return;
+    }
+    if (!translator_.hasRoomFor(block.length_)) {
+        // out of space, throw every translation away and start over
+        for (auto& entry : blockCache_) {
+            entry.translated_ = nullptr;
+        }
+        translator_.reset();
+    }
+    auto offsetInCore = [this](const void* field) noexcept {
+        return static_cast<int32_t>(reinterpret_cast<const byte*>(field) - reinterpret_cast<const byte*>(this));
+    };
+    const X86BlockTranslator::AccessGuard guard {
+        static_cast<Ordinal>(std::min<size_t>(bus_.size(), InternalSpaceStart)),
+        offsetInCore(staleFrame_.getFramePointerLocation()),
+        offsetInCore(&instructionCacheLowest_),
+        offsetInCore(&instructionCacheHighest_),
+    };
+    auto entry = translator_.begin();
+    auto address = block.address_;
+    uint16_t localsWritten = 0;
+    byte nativeCount = 0;
+    for (byte i = 0; i < block.length_; ++i) {
+        const auto& instruction = block.instructions_[i];
+        auto index = block.dispatch_[i];
+        auto callBack = [this, &instruction, index, address, &block, i]() noexcept {
+            translator_.fallback(jitFallback,
+                                 this,
+                                 &instruction,
+                                 static_cast<Ordinal>(index),
+                                 address,
+                                 &block,
+                                 block.address_,
+                                 i + 1);
+        };
+        if (translateAccess(translator_, guard, index, instruction, address, callBack) ||
+            translateInline(translator_, index, instruction, address)) {
+            ++nativeCount;
+            if (auto destination = instruction.getSrcDest(false); !isStore(index) && isLocalRegister(destination)) {
+                localsWritten |= 1u << static_cast<byte>(destination);
+            }
+        } else {
+            callBack();
+        }
+        address += instruction.getLength();
+    }
+    if ((nativeCount * 2) < block.length_) {
+        // a chain of fallbacks is slower than the interpreter loop it replaces, leave the block interpreted for good
+        translator_.abandon(entry);
+        return;
+    }
+    translator_.finish(address, block.length_);
+    block.translated_ = entry;
+    block.localsWritten_ = localsWritten;
+}
+#endif
@@ -24,7 +24,11 @@
 //
 // Created by jwscoggins on 1/22/22.
 //
+#include <string.h>
 #include "InternalBootProgram.h"
+#ifndef ARDUINO
+#define PROGMEM3
+#endif
 constexpr byte BootProgram0[] PROGMEM3 = {
         0x00, 0x00, 0xfd, 0xff, 0xb0, 0x00, 0xfd, 0xff, 0x00, 0x00, 0x00, 0x00,
         0xec, 0x06, 0xfd, 0xff, 0x64, 0xf8, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -534,8 +538,28 @@ static_assert(sizeof(BootProgram0) < 0x4000, "Internal verification program will
 uint8_t
 readFromInternalBootProgram(size_t index) noexcept {
     if (index < sizeof(BootProgram0)) {
+#ifdef ARDUINO
         return pgm_read_byte_far(pgm_get_far_address(BootProgram0) + index);
+#else
+        return BootProgram0[index];
+#endif
     } else {
         return 0;
     }
 }
+void
+readFromInternalBootProgram(size_t index, void* buffer, size_t count) noexcept {
+    size_t available = 0;
+    if (index < sizeof(BootProgram0)) {
+        available = sizeof(BootProgram0) - index;
+        if (available > count) {
+            available = count;
+        }
+#ifdef ARDUINO
+        memcpy_PF(buffer, pgm_get_far_address(BootProgram0) + index, available);
+#else
+        memcpy(buffer, BootProgram0 + index, available);
+#endif
+    }
+    memset(reinterpret_cast<byte*>(buffer) + available, 0, count - available);
+}
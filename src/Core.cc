@@ -21,7 +21,6 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Core.h"
-#include <Arduino.h>
 namespace
 {
     constexpr bool EnableEmulatorTrace = false;
@@ -76,10 +75,10 @@ Core::cycle() noexcept {
         Serial.print(F("\trip(before): 0x"));
         Serial.println(getRIP().get<Ordinal>(), HEX);
     }
-    advanceIPBy = 4;
-    auto instruction = loadInstruction(ip_.get<Ordinal>());
-    executeInstruction(instruction);
-    //executeInstruction(loadInstruction(ip_.get<Ordinal>()));
+    const auto& decoded = fetchDecodedInstruction(ip_.get<Ordinal>());
+    fillRegisters(getCurrentPack(), AllQuads);
+    advanceIPBy = decoded.instruction_.getLength();
+    executeInstruction(decoded.dispatch_, decoded.instruction_);
     if (advanceIPBy > 0)  {
         ip_.set<Ordinal>(ip_.get<Ordinal>() + advanceIPBy);
     }
@@ -91,10 +90,9 @@ Core::cycle() noexcept {
 
 Register&
 Core::getRegister(RegisterIndex targetIndex) {
-    if (isLocalRegister(targetIndex)) {
-        return getLocals().getRegister(static_cast<uint8_t>(targetIndex));
-    } else if (isGlobalRegister(targetIndex)) {
-        return globals.getRegister(static_cast<uint8_t>(targetIndex));
+    if (isRegister(targetIndex)) {
+        getCurrentPack().markDirty(static_cast<uint16_t>(isLocalRegister(targetIndex)) << (static_cast<byte>(targetIndex) & 0b1111));
+        return registerFile_.registers[fileIndexOf(targetIndex)];
     } else {
         /// @todo figure out what to return on a fault failure?
         generateFault(FaultType::Operation_InvalidOperand);
@@ -102,12 +100,23 @@ Core::getRegister(RegisterIndex targetIndex) {
     }
 }
 
+const Register&
+Core::getSourceRegister(RegisterIndex targetIndex) {
+    if (isRegister(targetIndex)) {
+        return registerFile_.registers[fileIndexOf(targetIndex)];
+    } else {
+        generateFault(FaultType::Operation_InvalidOperand);
+        return BadRegister;
+    }
+}
+
 DoubleRegister&
 Core::getDoubleRegister(RegisterIndex targetIndex) {
-    if (isLocalRegister(targetIndex)) {
-        return getLocals().getDoubleRegister(static_cast<int>(targetIndex));
-    } else if (isGlobalRegister(targetIndex)) {
-        return globals.getDoubleRegister(static_cast<int>(targetIndex));
+    if (isRegister(targetIndex)) {
+        if (isLocalRegister(targetIndex)) {
+            getCurrentPack().markDirty(0b11 << (static_cast<byte>(targetIndex) & 0b1110));
+        }
+        return windowOf(targetIndex).getDoubleRegister(static_cast<int>(targetIndex));
     } else {
         /// @todo figure out what to return on a fault failure?
         generateFault(FaultType::Operation_InvalidOperand);
@@ -118,10 +127,11 @@ Core::getDoubleRegister(RegisterIndex targetIndex) {
 
 TripleRegister&
 Core::getTripleRegister(RegisterIndex targetIndex) {
-    if (isLocalRegister(targetIndex)) {
-        return getLocals().getTripleRegister(static_cast<int>(targetIndex));
-    } else if (isGlobalRegister(targetIndex)) {
-        return globals.getTripleRegister(static_cast<int>(targetIndex));
+    if (isRegister(targetIndex)) {
+        if (isLocalRegister(targetIndex)) {
+            getCurrentPack().markDirty(0b0111 << (static_cast<byte>(targetIndex) & 0b1100));
+        }
+        return windowOf(targetIndex).getTripleRegister(static_cast<int>(targetIndex));
     } else {
         /// @todo figure out what to return on a fault failure?
         generateFault(FaultType::Operation_InvalidOperand);
@@ -129,12 +139,33 @@ Core::getTripleRegister(RegisterIndex targetIndex) {
     }
 }
 
+const TripleRegister&
+Core::getSourceTripleRegister(RegisterIndex targetIndex) {
+    if (isRegister(targetIndex)) {
+        return windowOf(targetIndex).getTripleRegister(static_cast<int>(targetIndex));
+    } else {
+        generateFault(FaultType::Operation_InvalidOperand);
+        return BadRegisterTriple;
+    }
+}
+
 QuadRegister&
 Core::getQuadRegister(RegisterIndex targetIndex) {
-    if (isLocalRegister(targetIndex)) {
-        return getLocals().getQuadRegister(static_cast<int>(targetIndex));
-    } else if (isGlobalRegister(targetIndex)) {
-        return globals.getQuadRegister(static_cast<int>(targetIndex));
+    if (isRegister(targetIndex)) {
+        if (isLocalRegister(targetIndex)) {
+            getCurrentPack().markDirty(0b1111 << (static_cast<byte>(targetIndex) & 0b1100));
+        }
+        return windowOf(targetIndex).getQuadRegister(static_cast<int>(targetIndex));
+    } else {
+        generateFault(FaultType::Operation_InvalidOperand);
+        return BadRegisterQuad;
+    }
+}
+
+const QuadRegister&
+Core::getSourceQuadRegister(RegisterIndex targetIndex) {
+    if (isRegister(targetIndex)) {
+        return windowOf(targetIndex).getQuadRegister(static_cast<int>(targetIndex));
     } else {
         generateFault(FaultType::Operation_InvalidOperand);
         return BadRegisterQuad;
@@ -143,34 +174,251 @@ Core::getQuadRegister(RegisterIndex targetIndex) {
 
 Instruction
 Core::loadInstruction(Address baseAddress) noexcept {
-    // load words 64-bits at a time for simplicity, we increment by eight on double wide instructions and four on single wide
     auto targetAddress = baseAddress & ~(static_cast<Address>(0b11));
-    auto theLong = loadLong(targetAddress);
-    return Instruction(theLong);
+    auto lowerHalf = fetchInstructionWord(targetAddress);
+    if (Instruction singleWide(lowerHalf); !singleWide.isDoubleWide()) {
+        return singleWide;
+    }
+    // only the MEMB forms with a displacement need the second word
+    return Instruction(static_cast<LongOrdinal>(lowerHalf) | (static_cast<LongOrdinal>(fetchInstructionWord(targetAddress + 4)) << 32));
+}
+Ordinal
+Core::fetchInstructionWord(Address address) noexcept {
+    if (auto line = address & PrefetchMask; line != prefetchAddress_) {
+        readBlock(line, reinterpret_cast<byte*>(prefetchBuffer_), PrefetchSize);
+        prefetchAddress_ = line;
+        if (line < instructionCacheLowest_) {
+            instructionCacheLowest_ = line;
+        }
+        if (auto last = line + (PrefetchSize - 1); last > instructionCacheHighest_) {
+            instructionCacheHighest_ = last;
+        }
+    }
+    return prefetchBuffer_[(address & (PrefetchSize - 1)) / sizeof(Ordinal)];
+}
+const Core::DecodedInstruction&
+Core::fetchDecodedInstruction(Address address) noexcept {
+    auto alignedAddress = address & ~(static_cast<Address>(0b11));
+    auto& entry = instructionCache_[(alignedAddress >> 2) & (NumInstructionCacheEntries - 1)];
+    if (entry.address_ != alignedAddress) {
+        entry.instruction_ = loadInstruction(alignedAddress);
+        entry.dispatch_ = decodeDispatchIndex(entry.instruction_);
+        entry.address_ = alignedAddress;
+        // we always fetch eight bytes so treat every entry as covering them
+        if (alignedAddress < instructionCacheLowest_) {
+            instructionCacheLowest_ = alignedAddress;
+        }
+        if (auto last = alignedAddress + 7; last > instructionCacheHighest_) {
+            instructionCacheHighest_ = last;
+        }
+    }
+    return entry;
+}
+Core::DecodedBlock&
+Core::fetchDecodedBlock(Address address) noexcept {
+    auto alignedAddress = address & ~(static_cast<Address>(0b11));
+    auto& block = blockCache_[(alignedAddress >> 2) & (NumBlockCacheEntries - 1)];
+    if (block.address_ != alignedAddress) {
+        byte count = 0;
+        auto current = alignedAddress;
+        byte quadsRead = 0;
+        do {
+            const auto& decoded = fetchDecodedInstruction(current);
+            block.instructions_[count] = decoded.instruction_;
+            block.dispatch_[count] = decoded.dispatch_;
+            quadsRead |= quadsReferencedBy(decoded.instruction_);
+            ++count;
+            current += decoded.instruction_.getLength();
+            if (endsBasicBlock(decoded.dispatch_)) {
+                break;
+            }
+        } while (count < MaxBlockLength);
+        block.length_ = count;
+        block.quadsRead_ = quadsRead;
+        // instruction fetches are always eight bytes wide
+        block.lastAddress_ = current + 3;
+        block.address_ = alignedAddress;
+#ifdef HOST_JIT
+        block.executions_ = 0;
+        block.translated_ = nullptr;
+        block.localsWritten_ = 0;
+#endif
+    }
+    return block;
+}
+size_t
+Core::run(size_t instructionBudget) noexcept {
+    size_t executed = 0;
+    while (executed < instructionBudget) {
+        auto blockAddress = ip_.get<Ordinal>() & ~(static_cast<Address>(0b11));
+        auto& block = fetchDecodedBlock(blockAddress);
+        auto& pack = getCurrentPack();
+        fillRegisters(pack, block.quadsRead_);
+#ifdef HOST_JIT
+        if (block.translated_) {
+            // the block can leave through a call, the inline writes all happened in the frame it started in
+            executed += block.translated_(this, &getLocals().getRegister(0), &registerFile_.windows[GlobalsWindow].getRegister(0), &ip_, bus_.hostMemory());
+            pack.markDirty(block.localsWritten_);
+            continue;
+        }
+#ifndef PROFILE_INSTRUCTIONS
+        // translated code never goes through executeInstruction, so profiled builds stay in the interpreter
+        if (++block.executions_ == JITThreshold) {
+            translateBlock(block);
+        }
+#endif
+#endif
+        for (byte i = 0; i < block.length_; ++i) {
+            const auto& instruction = block.instructions_[i];
+            advanceIPBy = instruction.getLength();
+            executeInstruction(block.dispatch_[i], instruction);
+            ++executed;
+            if (advanceIPBy == 0) {
+                // something (usually the branch at the end of the block) already moved the ip for us
+                break;
+            }
+            ip_.set<Ordinal>(ip_.get<Ordinal>() + advanceIPBy);
+            if (block.address_ != blockAddress) {
+                // the block just overwrote itself, so the rest of it is stale
+                break;
+            }
+        }
+    }
+    return executed;
+}
+void
+Core::invalidateInstructionCacheRange(Address destination, size_t count) noexcept {
+    // an entry covers eight bytes so anything starting up to a word before the store can overlap it
+    auto firstAddress = destination & ~(static_cast<Address>(0b11));
+    if (firstAddress != 0) {
+        firstAddress -= 4;
+    }
+    auto lastAddress = (destination + (count - 1)) & ~(static_cast<Address>(0b11));
+    for (Address i = 0, address = firstAddress, words = ((lastAddress - firstAddress) >> 2) + 1; i < words; ++i, address += 4) {
+        if (auto& entry = instructionCache_[(address >> 2) & (NumInstructionCacheEntries - 1)]; entry.address_ == address) {
+            entry.address_ = DecodedInstruction::InvalidAddress;
+        }
+    }
+    auto lastWritten = destination + (count - 1);
+    if (prefetchAddress_ <= lastWritten && destination <= (prefetchAddress_ + (PrefetchSize - 1))) {
+        prefetchAddress_ = DecodedInstruction::InvalidAddress;
+    }
+    for (auto& block : blockCache_) {
+        if (block.address_ <= lastWritten && destination <= block.lastAddress_) {
+            block.address_ = DecodedInstruction::InvalidAddress;
+        }
+    }
+}
+void
+Core::purgeInstructionCache() noexcept {
+    for (auto& entry : instructionCache_) {
+        entry.address_ = DecodedInstruction::InvalidAddress;
+    }
+    for (auto& block : blockCache_) {
+        block.address_ = DecodedInstruction::InvalidAddress;
+    }
+    instructionCacheLowest_ = 0xFFFF'FFFF;
+    instructionCacheHighest_ = 0;
+    prefetchAddress_ = DecodedInstruction::InvalidAddress;
+}
+
+void
+Core::saveRegisterFrame(const RegisterFrame &theFrame, Address baseAddress, uint16_t dirtyMask) noexcept {
+    ++frameSpills_;
+    if (canTransferBlock(baseAddress, RegisterFrame::Size)) {
+        prepareFrameTransfer(baseAddress);
+        // write each run of consecutive dirty registers as a single block
+        for (byte i = 0; i < 16;) {
+            if ((dirtyMask & (1u << i)) == 0) {
+                ++i;
+                continue;
+            }
+            byte first = i;
+            while (i < 16 && (dirtyMask & (1u << i))) {
+                ++i;
+            }
+            auto start = baseAddress + (first * sizeof(Register));
+            auto count = (i - first) * sizeof(Register);
+            invalidateInstructionCache(start, count);
+            storeFrameToBus(start, &theFrame.gprs[first], count);
+        }
+    } else {
+        for (byte i = 0; i < 16; ++i, baseAddress += 4) {
+            if (dirtyMask & (1u << i)) {
+                store(baseAddress, theFrame.getRegister(i).get<Ordinal>());
+            }
+        }
+    }
+}
+
+void
+Core::retireFrame(LocalRegisterPack& pack) noexcept {
+#ifdef FRAME_STORE
+    stashStaleFrame();
+#else
+    writeBackStaleFrame();
+#endif
+    // the pack walks off with the (now empty) window staleFrame_ had
+    staleFrame_.exchange(pack);
 }
 
+#ifdef FRAME_STORE
+void
+Core::stashStaleFrame() noexcept {
+    if (staleFrame_.valid()) {
+        auto address = staleFrame_.getFramePointerAddress();
+        auto dirtyMask = staleFrame_.getDirtyMask();
+        auto unloadedQuads = staleFrame_.getUnloadedQuads();
+        // forget it first, pushing can spill the oldest entry and that store comes back through writeBackStaleFrame
+        staleFrame_.relinquishOwnership();
+        frameStore_.push(staleFrame_.getUnderlyingFrame(), address, dirtyMask, unloadedQuads,
+                         [this](const RegisterFrame& frame, Address destination, uint16_t mask) noexcept { saveRegisterFrame(frame, destination, mask); });
+    }
+}
+#endif
+
 void
-Core::saveRegisterFrame(const RegisterFrame &theFrame, Address baseAddress) noexcept {
-    for (byte i = 0; i < 16; ++i, baseAddress += 4) {
-        store(baseAddress, theFrame.getRegister(i).get<Ordinal>());
+Core::writeBackStaleFrame() noexcept {
+    if (staleFrame_.valid()) {
+        auto address = staleFrame_.getFramePointerAddress();
+        auto dirtyMask = staleFrame_.getDirtyMask();
+        // forget it first, the fallback path in saveRegisterFrame goes through store which would otherwise come back here
+        staleFrame_.relinquishOwnership();
+        if (dirtyMask != 0) {
+            saveRegisterFrame(staleFrame_.getUnderlyingFrame(), address, dirtyMask);
+        }
     }
 }
 
 void
-Core::restoreRegisterFrame(RegisterFrame &theFrame, Address baseAddress) noexcept {
-    for (auto& reg : theFrame.gprs) {
-        reg.set<Ordinal>(load(baseAddress));
-        baseAddress += 4;
+Core::restoreRegisterFrame(RegisterFrame &theFrame, Address baseAddress, uint16_t mask) noexcept {
+    if (canTransferBlock(baseAddress, RegisterFrame::Size)) {
+        prepareFrameTransfer(baseAddress);
+        // read each run of consecutive requested registers as a single block
+        for (byte i = 0; i < 16;) {
+            if ((mask & (1u << i)) == 0) {
+                ++i;
+                continue;
+            }
+            byte first = i;
+            while (i < 16 && (mask & (1u << i))) {
+                ++i;
+            }
+            loadFrameFromBus(baseAddress + (first * sizeof(Register)), &theFrame.gprs[first], (i - first) * sizeof(Register));
+        }
+    } else {
+        for (byte i = 0; i < 16; ++i, baseAddress += 4) {
+            if (mask & (1u << i)) {
+                theFrame.getRegister(i).set<Ordinal>(load(baseAddress));
+            }
+        }
     }
 }
 
 Ordinal
 Core::computeMemoryAddress(const Instruction &instruction) noexcept {
     // assume we are looking at a correct style instruction :)
-    if (instruction.isDoubleWide()) {
-        // also make sure that we jump ahead by eight bytes instead of four
-        advanceIPBy += 4;
-    }
+    // cycle has already taken the length of double wide instructions into account
     switch (instruction.getMemFormatMode()) {
         case MEMFormatMode::MEMA_AbsoluteOffset:
             return instruction.getOffset();
@@ -298,14 +546,29 @@ Core::getInterruptStackPointer() noexcept {
 }
 
 Core::Core(Ordinal salign) : ip_(0), ac_(0), pc_(0), tc_(0), salign_(salign), c_((salign * 16) - 1), stackAlignMask_(c_ - 1), frameAlignmentMask_(~stackAlignMask_) {
+    for (Ordinal i = 0; i < NumRegisterFrames; ++i) {
+        frames[i].bindWindow(registerFile_.windows[i]);
+    }
+    staleFrame_.bindWindow(registerFile_.windows[NumRegisterFrames]);
+    // never written through, getRegister refuses to hand out literals as destinations
+    for (Ordinal i = 0; i < 32; ++i) {
+        registerFile_.registers[(LiteralsWindow * 16) + i].set<Ordinal>(i);
+    }
+    registerFile_.registers[ZeroRegister].set<Ordinal>(0);
 }
 
 void
 Core::flushreg(const Instruction&) noexcept {
     // clear all registers except the current one
-    for (Ordinal curr = currentFrameIndex_ + 1; curr != currentFrameIndex_; curr = ((curr + 1) % NumRegisterFrames)) {
-        frames[curr].relinquishOwnership([this](const RegisterFrame& frame, Address dest) noexcept {
-            saveRegisterFrame(frame, dest);
+    writeBackStaleFrame();
+#ifdef FRAME_STORE
+    frameStore_.writeBack([this](const RegisterFrame& frame, Address dest, uint16_t dirtyMask) noexcept { saveRegisterFrame(frame, dest, dirtyMask); });
+#endif
+    // the guest is allowed to rewrite the frames in memory after this so the current one can not be left half loaded
+    fillRegisters(getCurrentPack(), AllQuads);
+    for (Ordinal curr = (currentFrameIndex_ + 1) & RegisterFrameMask; curr != currentFrameIndex_; curr = ((curr + 1) & RegisterFrameMask)) {
+        frames[curr].relinquishOwnership([this](const RegisterFrame& frame, Address dest, uint16_t dirtyMask) noexcept {
+            saveRegisterFrame(frame, dest, dirtyMask);
         });
     }
 }
@@ -325,11 +588,11 @@ Core::cmpibx(const Instruction &instruction, uint8_t mask) noexcept {
 
 RegisterFrame&
 Core::getLocals() noexcept {
-    return frames[currentFrameIndex_].getUnderlyingFrame();
+    return registerFile_.windows[localsBase_ / 16];
 }
 const RegisterFrame&
 Core::getLocals() const noexcept {
-    return frames[currentFrameIndex_].getUnderlyingFrame();
+    return registerFile_.windows[localsBase_ / 16];
 }
 void
 Core::setFramePointer(Ordinal value) noexcept {
@@ -342,7 +605,7 @@ Core::getNextCallFrameStart() noexcept {
 }
 void
 Core::setRIP() noexcept {
-    getRIP().set<Ordinal>(ip_.get<Ordinal>() + advanceIPBy);
+    getRegister(RegisterIndex::RIP).set<Ordinal>(ip_.get<Ordinal>() + advanceIPBy);
 }
 void
 Core::setStackPointer(Ordinal value) noexcept {
@@ -364,7 +627,7 @@ Core::call(const Instruction& instruction) noexcept {
     enterCall(temp);
     ip_.set<Integer>(ip_.get<Integer>() + instruction.getDisplacement());
     /// @todo expand pfp and fp to accurately model how this works
-    getPFP().setAddress(fp);
+    getWritablePFP().setAddress(fp);
     setFramePointer(temp);
     setStackPointer(temp + 64);
     advanceIPBy = 0; // we already know where we are going so do not jump ahead
@@ -386,7 +649,7 @@ Core::callx(const Instruction& instruction) noexcept {
 /// @todo implement support for caching register frames
     enterCall(temp);
     absoluteBranch(memAddr);
-    getPFP().setAddress(fp);
+    getWritablePFP().setAddress(fp);
     setFramePointer(temp);
     setStackPointer(temp + 64);
 }
@@ -419,7 +682,7 @@ Core::calls(const Instruction& instruction) noexcept {
         }
         enterCall(temp);
         /// @todo expand pfp and fp to accurately model how this works
-        auto pfp = getPFP();
+        auto pfp = getWritablePFP();
         pfp.setAddress(getFramePointerValue());
         pfp.setReturnType(tempRRR);
         setFramePointer(temp);
@@ -539,11 +802,11 @@ Core::properFramePointerAddress() const noexcept {
 }
 Core::LocalRegisterPack&
 Core::getNextPack() noexcept {
-    return frames[(currentFrameIndex_ + 1) % NumRegisterFrames];
+    return frames[(currentFrameIndex_ + 1) & RegisterFrameMask];
 }
 Core::LocalRegisterPack&
 Core::getPreviousPack() noexcept {
-    return frames[(currentFrameIndex_ - 1) % NumRegisterFrames];
+    return frames[(currentFrameIndex_ - 1) & RegisterFrameMask];
 }
 void
 Core::exitCall() noexcept {
@@ -573,14 +836,37 @@ Core::exitCall() noexcept {
         Serial.print(F("targetAddress: 0x"));
         Serial.println(targetAddress, HEX);
     }
+    // slide the stack cache down first so the frame about to be restored is read out of it
+    followFramePointer(targetAddress);
     // okay we are done with the current frame so relinquish ownership
     frames[currentFrameIndex_].relinquishOwnership();
-    getPreviousPack().restoreOwnership(targetAddress,
-                                       [this](const RegisterFrame& frame, Address targetAddress) noexcept { saveRegisterFrame(frame, targetAddress); },
-                                       [this](RegisterFrame& frame, Address targetAddress) noexcept { restoreRegisterFrame(frame, targetAddress); });
+    auto saveFrame = [this](const RegisterFrame& frame, Address targetAddress, uint16_t dirtyMask) noexcept { saveRegisterFrame(frame, targetAddress, dirtyMask); };
+    if (auto& previous = getPreviousPack(); staleFrame_.valid() && staleFrame_.getFramePointerAddress() == targetAddress) {
+        // the caller was only evicted lazily, hand its pack straight back (dirty registers and all)
+        previous.relinquishOwnership(saveFrame);
+        previous.exchange(staleFrame_);
+    } else {
+        previous.restoreOwnership(targetAddress, saveFrame, [this, &previous]([[maybe_unused]] RegisterFrame& frame, [[maybe_unused]] Address address) noexcept {
+#ifdef FRAME_STORE
+            // a frame held in the frame store comes back exactly as it left, dirty and unloaded registers included
+            if (frameStore_.take(address, [&previous, &frame](const FrameStore::Entry& entry) noexcept {
+                    memcpy(&frame, &entry.registers_, sizeof(RegisterFrame));
+                    previous.markDirty(entry.dirty_);
+                    previous.markUnloaded(entry.unloadedQuads_);
+                })) {
+                return;
+            }
+#endif
+            // only the linkage registers (pfp, sp and rip) are needed right away, blocks pull in the rest as they use them;
+            // the quads read in later are part of this fill rather than fills of their own
+            ++frameFills_;
+            previous.markUnloaded(AllQuads);
+            fillRegisters(previous, 0b0001);
+        });
+    }
     // okay the restoration is complete so just decrement the address
-    --currentFrameIndex_;
-    currentFrameIndex_ %= NumRegisterFrames;
+    currentFrameIndex_ = (currentFrameIndex_ - 1) & RegisterFrameMask;
+    rebindLocals();
     if constexpr (EnableEmulatorTrace) {
         Serial.print(F("New Frame Index: 0x"));
         Serial.println(currentFrameIndex_, HEX);
@@ -610,10 +896,18 @@ Core::enterCall(Address newFP) noexcept {
         Serial.println(newFP, HEX);
     }
     // this is much simpler than exiting, we just need to take control of the next register frame in the set
-    getNextPack().takeOwnership(newFP, [this](const RegisterFrame& frame, Address address) noexcept { saveRegisterFrame(frame, address); });
+    auto& next = getNextPack();
+    if (next.valid()) {
+        retireFrame(next);
+    }
+    // if the new frame is reusing the stack of the stale one (or of one in the frame store) its old contents have to land
+    // before the new ones do
+    writeBackStaleFrame(newFP, RegisterFrame::Size);
+    next.takeOwnership(newFP, [this](const RegisterFrame& frame, Address address, uint16_t dirtyMask) noexcept { saveRegisterFrame(frame, address, dirtyMask); });
     // then increment the frame index
-    ++currentFrameIndex_;
-    currentFrameIndex_ %= NumRegisterFrames;
+    currentFrameIndex_ = (currentFrameIndex_ + 1) & RegisterFrameMask;
+    rebindLocals();
+    followFramePointer(newFP);
     if constexpr (EnableEmulatorTrace) {
         Serial.print(F("New Frame Index: 0x"));
         Serial.println(currentFrameIndex_, HEX);
@@ -623,7 +917,7 @@ Core::enterCall(Address newFP) noexcept {
 }
 
 void
-Core::mark(const Instruction& inst) noexcept {
+Core::mark([[maybe_unused]] const Instruction& inst) noexcept {
 // Generates a breakpoint trace-event if the breakpoint trace mode has been enabled.
 // The breakpoint trace mode is enabled if the trace-enable bit (bit 0) of the process
 // controls and the breakpoint-trace mode bit (bit 7) of the trace controls have been zet
@@ -682,9 +976,9 @@ Core::withCarryOperationGeneric(const Instruction &instruction, ArithmeticWithCa
     ac_.setCarryBit(result.get(1, TreatAsOrdinal{}) != 0);
 }
 namespace {
-    [[nodiscard]] constexpr Ordinal wordAlign(Ordinal value) noexcept { return value & 0xFFFF'FFF0; }
+    [[nodiscard]] constexpr Ordinal wordAlign(Ordinal value) noexcept { return value & 0xFFFF'FFFC; }
     [[nodiscard]] constexpr Ordinal doubleWordAlign(Ordinal value) noexcept { return value & 0xFFFF'FFF8; }
-    [[nodiscard]] constexpr Ordinal quadWordAlign(Ordinal value) noexcept { return value & 0xFFFF'FFFC; }
+    [[nodiscard]] constexpr Ordinal quadWordAlign(Ordinal value) noexcept { return value & 0xFFFF'FFF0; }
 }
 void Core::synld(const Instruction& instruction) noexcept {
     // wait until another execution unit sets the condition codes to continue after requesting a load.
@@ -745,12 +1039,12 @@ Core::synmovq(const Instruction &instruction) noexcept {
 
 void
 Core::lockBus() noexcept {
-    /// @todo implement this
+    bus_.lockBus();
 }
 
 void
 Core::unlockBus() noexcept {
-    /// @todo implement this
+    bus_.unlockBus();
 }
 
 void
@@ -775,7 +1069,8 @@ Core::bx(const Instruction& inst) noexcept {
 }
 void
 Core::synchronizeMemoryRequests() noexcept {
-
+    // every store issued before this point has to be visible on the bus
+    writeBackDataCache();
 }
 void
 Core::notbit(const Instruction& instruction) noexcept {
@@ -841,8 +1136,8 @@ namespace {
 }
 void
 Core::scanbyte(const Instruction &instruction) noexcept {
-    const auto& src1 = getRegister(instruction.getSrc1());
-    const auto& src2 = getRegister(instruction.getSrc2());
+    const auto& src1 = getSourceRegister(instruction.getSrc1());
+    const auto& src2 = getSourceRegister(instruction.getSrc2());
     for (byte i = 0;i < 4; ++i) {
         if (bytesEqual(src1, src2, i)) {
             ac_.setConditionCode(0b010);
@@ -915,13 +1210,22 @@ Core::atadd(const Instruction& instruction) noexcept {
     // The initial value from memory is stored in dst (internally src/dst).
     syncf();
     auto addr = wordAlign(valueFromSrc1Register<Ordinal>(instruction));
-    lockBus();
-    auto temp = load(addr);
     auto src = valueFromSrc2Register<Ordinal>(instruction);
-    store(addr, temp + src);
-    unlockBus();
+    Ordinal temp;
+    if (inInternalSpace(addr)) {
+        // internal space belongs to this core alone
+        lockBus();
+        temp = load(addr);
+        store(addr, temp + src);
+        unlockBus();
+    } else {
+        // atomics have to see and update the bus itself, not a cached copy
+        writeBackStaleFrame(addr, sizeof(Ordinal));
+        flushDataCache(addr, sizeof(Ordinal));
+        invalidateInstructionCache(addr, sizeof(Ordinal));
+        temp = bus_.atomicAdd(addr, src);
+    }
     setDestinationFromSrcDest(instruction, temp, TreatAsOrdinal{});
-
 }
 
 void
@@ -931,12 +1235,20 @@ Core::atmod(const Instruction &instruction) noexcept {
     // value from memory is stored in src/dest
     syncf();
     auto addr = wordAlign(valueFromSrc1Register<Ordinal>(instruction));
-    lockBus();
-    auto temp = load(addr);
     auto& dest = destinationFromSrcDest(instruction);
     auto mask = valueFromSrc2Register<Ordinal>(instruction);
-    store(addr, (dest.get<Ordinal>() & mask) | (temp & ~mask));
-    unlockBus();
+    Ordinal temp;
+    if (inInternalSpace(addr)) {
+        lockBus();
+        temp = load(addr);
+        store(addr, (dest.get<Ordinal>() & mask) | (temp & ~mask));
+        unlockBus();
+    } else {
+        writeBackStaleFrame(addr, sizeof(Ordinal));
+        flushDataCache(addr, sizeof(Ordinal));
+        invalidateInstructionCache(addr, sizeof(Ordinal));
+        temp = bus_.atomicModify(addr, mask, dest.get<Ordinal>());
+    }
     dest.set<Ordinal>(temp);
 }
 void
@@ -988,7 +1300,7 @@ Core::bal(const Instruction &inst) noexcept {
 }
 
 void
-Core::illegalInstruction(const Instruction &inst) noexcept {
+Core::illegalInstruction([[maybe_unused]] const Instruction &inst) noexcept {
     generateFault(FaultType::Operation_InvalidOpcode) ;
 }
 void
@@ -1073,3 +1385,51 @@ Core::modtc(const Instruction &instruction) noexcept {
     auto src = valueFromSrc2Register<Ordinal>(instruction);
     dest.set<Ordinal>(tc_.modify(mask, src));
 }
+void
+Core::boot0(Ordinal sat, Ordinal pcb, Ordinal startIP) {
+    systemAddressTableBase_ = sat;
+    prcbBase_ = pcb;
+    // skip the check words
+    absoluteBranch(startIP);
+    pc_.setPriority(31);
+    pc_.setState(true); // needs to be set as interrupted
+    auto thePointer = getInterruptStackPointer();
+    // also make sure that we set the target pack to zero
+    currentFrameIndex_ = 0;
+    rebindLocals();
+    // invalidate all cache entries forcefully
+    staleFrame_.relinquishOwnership();
+#ifdef FRAME_STORE
+    frameStore_.clear();
+#endif
+    for (auto& a : frames) {
+        a.relinquishOwnership();
+        // at this point we want all of the locals to be cleared, this is the only time
+        for (auto& reg : a.getUnderlyingFrame().dprs) {
+            reg.set(0, TreatAsLongOrdinal{});
+        }
+    }
+    setFramePointer(thePointer);
+    followFramePointer(thePointer);
+    // we need to take ownership of the target frame on startup
+    // we want to take ownership and throw anything out just in case so make the lambda do nothing
+    getCurrentPack().takeOwnership(thePointer, [](const auto&, auto, auto) noexcept { });
+    // the locals were just cleared so make sure the zeroes make it out to the stack on the first spill
+    getCurrentPack().markDirty(0xFFFF);
+    // THE MANUAL DOESN'T STATE THAT YOU NEED TO SETUP SP and PFP as well, but you do!
+    setStackPointer(thePointer + 64);
+    getWritablePFP().setWhole(thePointer);
+}
+void
+Core::boot(Address base) {
+    auto q = loadQuad(base);
+    boot0(q.getOrdinal(0), q.getOrdinal(1), q.getOrdinal(3));
+}
+Ordinal
+Core::getSystemAddressTableBase() const noexcept {
+    return systemAddressTableBase_;
+}
+Ordinal
+Core::getPRCBPtrBase() const noexcept {
+    return prcbBase_;
+}
@@ -0,0 +1,57 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Desktop (host) platform bring up for the emulator core, the counterpart to EBISBCore.cc
+//
+#ifdef DESKTOP_BUILD
+#include <cstdlib>
+#include "Types.h"
+#include "Core.h"
+
+void
+haltExecution(const __FlashStringHelper* message) noexcept {
+    Serial.print(F("HALTING EXECUTION: "));
+    Serial.println(message);
+    Serial.flush();
+    std::exit(1);
+}
+void
+Core::begin() noexcept {
+    Serial.println(F("STARTING UP HOSTED i960 Processor"));
+    // mirror what the mega2560 stores in its EEPROM so that software can find the builtin devices
+    for (int i = 0; i < static_cast<int>(Builtin::Devices::Count); ++i) {
+        auto baseAddress = Builtin::computeBaseAddress(static_cast<Builtin::Devices>(i));
+        for (int j = 0; j < static_cast<int>(sizeof(Address)); ++j) {
+            bus_.writeConfigurationSpace((i * sizeof(Address)) + j, static_cast<byte>(baseAddress >> (j * 8)));
+        }
+    }
+#ifdef PROFILE_INSTRUCTIONS
+    Profiler::begin();
+#endif
+    boot(Builtin::InternalBootProgramBase);
+}
+void
+Core::checksumFail() noexcept {
+    haltExecution(F("CHECKSUM FAILURE"));
+}
+#endif
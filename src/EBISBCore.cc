@@ -124,6 +124,10 @@ Core::begin() noexcept {
     Serial.print(F("Size of double (long real) = ")); Serial.println(sizeof(double));
     Serial.print(F("Size of float (real) = ")); Serial.println(sizeof(float));
     setupEBI();
+#ifdef DATA_CACHE
+    // the lower window is only reachable once the EBI is up
+    dataCache_.clear();
+#endif
     setupInterruptPins();
     setupInternalConfigurationSpace();
     configureLED();
@@ -131,55 +135,16 @@ Core::begin() noexcept {
     bringUpSPI();
     bringUpI2C();
     /// @todo setup all of the mega2560 peripherals here
+#ifdef PROFILE_INSTRUCTIONS
+    Profiler::begin();
+#endif
     boot(Builtin::InternalBootProgramBase);
 }
 
-void
-Core::boot0(Ordinal sat, Ordinal pcb, Ordinal startIP) {
-    systemAddressTableBase_ = sat;
-    prcbBase_ = pcb;
-    // skip the check words
-    absoluteBranch(startIP);
-    pc_.setPriority(31);
-    pc_.setState(true); // needs to be set as interrupted
-    auto thePointer = getInterruptStackPointer();
-    // also make sure that we set the target pack to zero
-    currentFrameIndex_ = 0;
-    // invalidate all cache entries forcefully
-    for (auto& a : frames) {
-        a.relinquishOwnership();
-        // at this point we want all of the locals to be cleared, this is the only time
-        for (auto& reg : a.getUnderlyingFrame().dprs) {
-            reg.set(0, TreatAsLongOrdinal{});
-        }
-    }
-    setFramePointer(thePointer);
-    // we need to take ownership of the target frame on startup
-    // we want to take ownership and throw anything out just in case so make the lambda do nothing
-    getCurrentPack().takeOwnership(thePointer, [](const auto&, auto) noexcept { });
-    // THE MANUAL DOESN'T STATE THAT YOU NEED TO SETUP SP and PFP as well, but you do!
-    setStackPointer(thePointer + 64);
-    getPFP().setWhole(thePointer);
-}
-void
-Core::boot(Address base) {
-    auto q = loadQuad(base);
-    boot0(q.getOrdinal(0), q.getOrdinal(1), q.getOrdinal(3));
-}
-Ordinal
-Core::getSystemAddressTableBase() const noexcept {
-    return systemAddressTableBase_;
-}
-Ordinal
-Core::getPRCBPtrBase() const noexcept {
-    return prcbBase_;
-}
-
-
 void
 Core::checksumFail() noexcept {
     digitalWrite(LED_BUILTIN, HIGH);
     while (true) {
         delay(1000);
     }
-}
\ No newline at end of file
+}
@@ -32,7 +32,7 @@ Core::destinationFromSrc2(const Instruction &instruction) noexcept {
 }
 const Register&
 Core::registerFromSrc1(const Instruction& instruction) noexcept {
-    return getRegister(instruction.getSrc1());
+    return getSourceRegister(instruction.getSrc1());
 }
 void
 Core::bswap(const Instruction& inst) noexcept {
@@ -27,12 +27,12 @@
 #include "Core.h"
 
 void
-Core::generateFault(FaultType faultKind) noexcept {
+Core::generateFault([[maybe_unused]] FaultType faultKind) noexcept {
+    // the fault record and handler see the whole interrupted frame, not just what the faulting block had read
+    fillRegisters(getCurrentPack(), AllQuads);
 /// @todo implement proper fault handling support instead of this terminate system
     Serial.print(F("FAULT GENERATED AT 0x"));
     Serial.print(ip_.get<Ordinal>(), HEX);
-    Serial.println(F("! HALTING!!"));
-    while (true) {
-        delay(1000);
-    }
+    Serial.println(F("!"));
+    haltExecution(F("UNHANDLED FAULT"));
 }
@@ -0,0 +1,145 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Host memory management for HostBusBackend, guest ram is an anonymous mapping that memory image files can be mapped over
+//
+#ifdef DESKTOP_BUILD
+#include <cstdio>
+#include <new>
+#if __has_include(<sys/mman.h>)
+#define HOST_BUS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "HostBusBackend.h"
+
+namespace {
+    constexpr size_t computeMappingSize(size_t size) noexcept {
+        return size + sizeof(LongOrdinal);
+    }
+#ifdef HOST_BUS_MMAP
+    byte*
+    mapAnonymous(void* where, size_t length) noexcept {
+        // anonymous pages are zero filled on first touch so a large guest ram costs nothing until it is actually used
+        auto flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | (where ? MAP_FIXED : 0);
+        auto memory = mmap(where, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+        return memory == MAP_FAILED ? nullptr : reinterpret_cast<byte*>(memory);
+    }
+    bool
+    copyFromFile(int fd, byte* destination, size_t length) noexcept {
+        for (size_t offset = 0; offset < length; ) {
+            auto count = pread(fd, destination + offset, length - offset, static_cast<off_t>(offset));
+            if (count <= 0) {
+                return false;
+            }
+            offset += static_cast<size_t>(count);
+        }
+        return true;
+    }
+#endif
+}
+
+HostBusBackend::HostBusBackend(size_t size) : size_(size), mask_(size - 1), memory_(nullptr) {
+#ifdef HOST_BUS_MMAP
+    memory_ = mapAnonymous(nullptr, computeMappingSize(size));
+    if (!memory_) {
+        throw std::bad_alloc();
+    }
+#else
+    memory_ = new byte[computeMappingSize(size)]();
+#endif
+}
+
+HostBusBackend::~HostBusBackend() {
+#ifdef HOST_BUS_MMAP
+    munmap(memory_, computeMappingSize(size_));
+#else
+    delete [] memory_;
+#endif
+}
+
+void
+HostBusBackend::clear() noexcept {
+#ifdef HOST_BUS_MMAP
+    // replacing the whole mapping also throws away any attached image
+    if (!mapAnonymous(memory_, computeMappingSize(size_))) {
+        std::memset(memory_, 0, size_);
+    }
+#else
+    std::memset(memory_, 0, size_);
+#endif
+}
+
+bool
+HostBusBackend::mapImage(const char* path, Address base, ImageMapping mode) noexcept {
+    auto offset = translate(base);
+#ifdef HOST_BUS_MMAP
+    auto fd = open(path, mode == ImageMapping::Shared ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool success = false;
+    if (struct stat info{}; fstat(fd, &info) == 0) {
+        auto length = static_cast<size_t>(info.st_size);
+        auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        if (length == 0) {
+            success = true;
+        } else if ((offset + length) > size_) {
+            success = false;
+        } else if ((offset % pageSize) == 0) {
+            auto flags = (mode == ImageMapping::Shared ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED;
+            success = mmap(memory_ + offset, length, PROT_READ | PROT_WRITE, flags, fd, 0) != MAP_FAILED;
+            if (!success) {
+                // a failed fixed mapping can leave a hole behind, plug it with fresh zero pages
+                auto pages = ((length + pageSize - 1) / pageSize) * pageSize;
+                mapAnonymous(memory_ + offset, pages);
+            }
+        } else if (mode == ImageMapping::Private) {
+            // the kernel can only map whole pages, an unaligned private image still works by copying it in
+            success = copyFromFile(fd, memory_ + offset, length);
+        }
+    }
+    close(fd);
+    return success;
+#else
+    if (mode == ImageMapping::Shared) {
+        return false;
+    }
+    auto file = std::fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    bool success = false;
+    if (std::fseek(file, 0, SEEK_END) == 0) {
+        if (auto length = std::ftell(file); length >= 0 && (offset + static_cast<size_t>(length)) <= size_) {
+            std::rewind(file);
+            success = std::fread(memory_ + offset, 1, static_cast<size_t>(length), file) == static_cast<size_t>(length);
+        }
+    }
+    std::fclose(file);
+    return success;
+#endif
+}
+#endif
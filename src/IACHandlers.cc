@@ -26,10 +26,9 @@
 
 #include "Core.h"
 void
-Core::purgeInstructionCache(const IACMessage &message) noexcept {
-// do nothing as we don't have an instruction cache
-// this is not the register cache!
-/// @todo implement
+Core::purgeInstructionCache(const IACMessage &) noexcept {
+// this is the decoded instruction cache, not the register cache!
+    purgeInstructionCache();
 }
 
 void
@@ -37,7 +36,7 @@ Core::reinitializeProcessor(const IACMessage &message) noexcept {
     boot0(message.getField3(), message.getField4(), message.getField5());
 }
 void
-Core::setBreakpointRegister(const IACMessage &message) noexcept {
+Core::setBreakpointRegister([[maybe_unused]] const IACMessage &message) noexcept {
 /// @todo implement
 }
 void
@@ -49,14 +48,14 @@ Core::storeSystemBase(const IACMessage &message) noexcept {
     storeLong(message.getField3(), pack.get(TreatAsLongOrdinal{}));
 }
 void
-Core::generateSystemInterrupt(const IACMessage &message) noexcept {
+Core::generateSystemInterrupt([[maybe_unused]] const IACMessage &message) noexcept {
 // Generates an interrupt request. The interrup vector is given in field 1 of the IAC message. The processor handles the
 // interrupt request just as it does interrupts received from other sources. If the interrupt priority is higher than the prcessor's
 // current priority, the processor services the interrupt immediately. Otherwise, it posts the interrup in the pending interrupts
 // section of the interrupt table.
 }
 void
-Core::testPendingInterrupts(const IACMessage &message) noexcept {
+Core::testPendingInterrupts([[maybe_unused]] const IACMessage &message) noexcept {
 // tests for pending interrupts. The processor checks the pending interrupt section of the interrupt
 // table for a pending interrupt with a priority higher than the prcoessor's current priority. If a higher
 // priority interrupt is found, it is serviced immediately. Otherwise, no action is taken
@@ -65,11 +64,14 @@ Core::testPendingInterrupts(const IACMessage &message) noexcept {
 }
 void
 Core::processIACMessage(const IACMessage &message) noexcept {
+    // the synchronized store which delivered this message has already written the data cache back
     switch (message.getMessageType()) {
         case 0x89: // purge instruction cache
             purgeInstructionCache(message);
             break;
         case 0x93: // reinitialize processor
+            // start over with nothing cached, the new system image may have been put in place behind our back
+            flushDataCache();
             reinitializeProcessor(message);
             break;
         case 0x8F: // set breakpoint register
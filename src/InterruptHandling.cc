@@ -29,5 +29,14 @@
 
 void
 Core::generateInterrupt(uint16_t index) noexcept {
-    /// @todo implement eventually
+    // an interrupt handler can look at anything in the interrupted frame
+    fillRegisters(getCurrentPack(), AllQuads);
+    /// @todo actually service interrupts, for now they are only ever posted
+    // post the interrupt in the interrupt table exactly like one which arrives while the processor is at a higher priority:
+    // set the bit for its priority (vector / 8) in the pending priorities word and its bit in the pending interrupts field
+    auto vector = static_cast<byte>(index);
+    auto table = getInterruptTableBase();
+    store(table, load(table) | (static_cast<Ordinal>(1) << (vector >> 3)));
+    auto pendingWord = table + sizeof(Ordinal) + ((vector >> 5) * sizeof(Ordinal));
+    store(pendingWord, load(pendingWord) | (static_cast<Ordinal>(1) << (vector & 0x1F)));
 }
\ No newline at end of file
@@ -21,25 +21,20 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#ifdef ARDUINO
 #include <Arduino.h>
-#include <EEPROM.h>
 #include <SPI.h>
+#endif
 #include "Core.h"
 #include "Types.h"
 #include "InternalBootProgram.h"
 
-/**
- * @brief Defines the start of the internal cache memory connected on the EBI, this is used by the microcontroller itself for whatever it needs (lower 32k)
- */
-constexpr size_t CacheMemoryWindowStart = (RAMEND + 1);
-
-
 namespace {
     constexpr auto getCPUClockFrequency() noexcept {
         return F_CPU;
     }
     constexpr auto EnableEmulatorTrace = false;
-
+#ifdef ARDUINO
     class SPIInterface {
     public:
         enum class Registers : byte {
@@ -172,15 +167,37 @@ namespace {
             }
         }
     };
+#endif
     class QueryInterface {
     public:
         enum class Registers : byte {
 #define Register16(name) name ## 0, name ## 1
 #define Register32(name) Register16(name ## 0), Register16(name ## 1)
+#define Register64(name) Register32(name ## 0), Register32(name ## 1)
             Register32(ClockFrequency),
+            // instruction profile window, write a dispatch index to ProfileSelect and then read its counters
+            ProfileSelect,
+            ProfileControl,
+            Register16(ProfileEntries),
+            Register32(ProfileCount),
+            Register64(ProfileElapsed),
+            // EBI window statistics, write anything to BusStatisticsControl to reset them
+            BusStatisticsControl,
+            Register32(WindowSwitches),
+            Register32(SplitTransfers),
+            // register frame spill/fill counts, write anything to FrameStatisticsControl to reset them
+            FrameStatisticsControl,
+            Register32(FrameSpills),
+            Register32(FrameFills),
+#undef Register64
 #undef Register32
 #undef Register16
         };
+        enum class ProfileCommands : byte {
+            None,
+            Clear,
+            Dump,
+        };
         QueryInterface() = delete;
         ~QueryInterface() = delete;
         QueryInterface(QueryInterface&&) = delete;
@@ -188,17 +205,169 @@ namespace {
         QueryInterface& operator=(const QueryInterface&) = delete;
         QueryInterface& operator=(QueryInterface&&) = delete;
     public:
-        static byte read(byte offset) noexcept {
+        static byte read([[maybe_unused]] const Core& core, byte offset) noexcept {
             switch (static_cast<Registers>(offset)) {
                 case Registers::ClockFrequency00: return static_cast<byte>(getCPUClockFrequency());
                 case Registers::ClockFrequency01: return static_cast<byte>(getCPUClockFrequency() >> 8);
                 case Registers::ClockFrequency10: return static_cast<byte>(getCPUClockFrequency() >> 16);
                 case Registers::ClockFrequency11: return static_cast<byte>(getCPUClockFrequency() >> 24);
+#ifdef PROFILE_INSTRUCTIONS
+                case Registers::ProfileSelect: return profileSelect_;
+                case Registers::ProfileEntries0: return static_cast<byte>(Core::Profiler::Size);
+                case Registers::ProfileEntries1: return static_cast<byte>(Core::Profiler::Size >> 8);
+#endif
                 default:
+                    if (auto index = static_cast<byte>(offset - static_cast<byte>(Registers::FrameSpills00)); index < sizeof(Ordinal)) {
+                        return static_cast<byte>(core.getFrameSpills() >> (index * 8));
+                    } else if (auto index = static_cast<byte>(offset - static_cast<byte>(Registers::FrameFills00)); index < sizeof(Ordinal)) {
+                        return static_cast<byte>(core.getFrameFills() >> (index * 8));
+                    }
+#ifdef PROFILE_INSTRUCTIONS
+                    if (auto index = static_cast<byte>(offset - static_cast<byte>(Registers::ProfileCount00)); index < sizeof(Ordinal)) {
+                        return static_cast<byte>(core.getInstructionProfile().getCount(profileSelect_) >> (index * 8));
+                    } else if (auto index = static_cast<byte>(offset - static_cast<byte>(Registers::ProfileElapsed000)); index < sizeof(LongOrdinal)) {
+                        return static_cast<byte>(core.getInstructionProfile().getElapsed(profileSelect_) >> (index * 8));
+                    }
+#endif
+#ifdef ARDUINO
+                    if (auto index = static_cast<byte>(offset - static_cast<byte>(Registers::WindowSwitches00)); index < sizeof(Ordinal)) {
+                        return static_cast<byte>(core.getBus().getWindowSwitches() >> (index * 8));
+                    } else if (auto index = static_cast<byte>(offset - static_cast<byte>(Registers::SplitTransfers00)); index < sizeof(Ordinal)) {
+                        return static_cast<byte>(core.getBus().getSplitTransfers() >> (index * 8));
+                    }
+#endif
                     return 0;
             }
         }
-        static void write(byte, byte) noexcept { }
+        static void write([[maybe_unused]] Core& core, byte offset, [[maybe_unused]] byte value) noexcept {
+            switch (static_cast<Registers>(offset)) {
+#ifdef PROFILE_INSTRUCTIONS
+                case Registers::ProfileSelect:
+                    profileSelect_ = value;
+                    break;
+                case Registers::ProfileControl:
+                    switch (static_cast<ProfileCommands>(value)) {
+                        case ProfileCommands::Clear:
+                            core.clearInstructionProfile();
+                            break;
+                        case ProfileCommands::Dump:
+                            core.dumpInstructionProfile();
+                            break;
+                        default:
+                            break;
+                    }
+                    break;
+#endif
+#ifdef ARDUINO
+                case Registers::BusStatisticsControl:
+                    core.getBus().clearStatistics();
+                    break;
+#endif
+                case Registers::FrameStatisticsControl:
+                    core.clearFrameStatistics();
+                    break;
+                default:
+                    break;
+            }
+        }
+#ifdef PROFILE_INSTRUCTIONS
+    private:
+        static inline byte profileSelect_ = 0;
+#endif
+    };
+    /**
+     * @brief Bulk copy/fill/move engine. Program the source, destination, length and mode registers and then write Start
+     * to the control register; the transfer is done by the time the write completes.
+     */
+    class DMAEngine {
+    public:
+        enum class Registers : byte {
+#define Register16(name) name ## 0, name ## 1
+#define Register32(name) Register16(name ## 0), Register16(name ## 1)
+            Register32(Source),
+            Register32(Destination),
+            Register32(Length),
+            // a Core::BlockOperation, fills use the low byte of Source as the value
+            Mode,
+            Control,
+            Status,
+            InterruptVector,
+#undef Register32
+#undef Register16
+        };
+        enum class ControlBits : byte {
+            Start = 0b01,
+            InterruptOnCompletion = 0b10,
+        };
+        enum class StatusCodes : byte {
+            Idle,
+            Done,
+            BadMode,
+        };
+        DMAEngine() = delete;
+        ~DMAEngine() = delete;
+        DMAEngine(DMAEngine&&) = delete;
+        DMAEngine(const DMAEngine&) = delete;
+        DMAEngine& operator=(const DMAEngine&) = delete;
+        DMAEngine& operator=(DMAEngine&&) = delete;
+    public:
+        static byte read(byte offset) noexcept {
+            switch (static_cast<Registers>(offset)) {
+                case Registers::Mode: return mode_;
+                case Registers::Status: return static_cast<byte>(status_);
+                case Registers::InterruptVector: return vector_;
+                default:
+                    if (offset < static_cast<byte>(Registers::Mode)) {
+                        return static_cast<byte>(addressRegisters_[offset / sizeof(Ordinal)] >> ((offset % sizeof(Ordinal)) * 8));
+                    }
+                    return 0;
+            }
+        }
+        static void write(Core& core, byte offset, byte value) noexcept {
+            switch (static_cast<Registers>(offset)) {
+                case Registers::Mode:
+                    mode_ = value;
+                    break;
+                case Registers::Control:
+                    if (value & static_cast<byte>(ControlBits::Start)) {
+                        start(core, value & static_cast<byte>(ControlBits::InterruptOnCompletion));
+                    }
+                    break;
+                case Registers::InterruptVector:
+                    vector_ = value;
+                    break;
+                default:
+                    if (offset < static_cast<byte>(Registers::Mode)) {
+                        auto& target = addressRegisters_[offset / sizeof(Ordinal)];
+                        auto shift = (offset % sizeof(Ordinal)) * 8;
+                        target = (target & ~(static_cast<Ordinal>(0xFF) << shift)) | (static_cast<Ordinal>(value) << shift);
+                    }
+                    break;
+            }
+        }
+    private:
+        static void start(Core& core, bool raiseInterrupt) noexcept {
+            if (mode_ > static_cast<byte>(Core::BlockOperation::Move)) {
+                status_ = StatusCodes::BadMode;
+                return;
+            }
+            core.transferBlock(static_cast<Core::BlockOperation>(mode_),
+                               addressRegisters_[DestinationIndex],
+                               addressRegisters_[SourceIndex],
+                               addressRegisters_[LengthIndex]);
+            status_ = StatusCodes::Done;
+            if (raiseInterrupt) {
+                core.requestInterrupt(vector_);
+            }
+        }
+    private:
+        static constexpr byte SourceIndex = 0;
+        static constexpr byte DestinationIndex = 1;
+        static constexpr byte LengthIndex = 2;
+        static inline Ordinal addressRegisters_[3] = { 0 };
+        static inline byte mode_ = 0;
+        static inline byte vector_ = 0;
+        static inline StatusCodes status_ = StatusCodes::Idle;
     };
     class SerialConsole {
     public:
@@ -301,10 +470,10 @@ namespace {
         GPIOInterface& operator=(const GPIOInterface&) = delete;
         GPIOInterface& operator=(GPIOInterface&&) = delete;
     public:
-        static void write(byte offset, byte value) noexcept {
+        static void write([[maybe_unused]] byte offset, [[maybe_unused]] byte value) noexcept {
             /// @todo implement
         }
-        static byte read(byte offset) noexcept {
+        static byte read([[maybe_unused]] byte offset) noexcept {
             /// @todo implement
             return 0;
         }
@@ -312,36 +481,30 @@ namespace {
 }
 ByteOrdinal
 Core::readFromInternalSpace(Address destination) noexcept {
-    constexpr byte BootProgramBaseStart = static_cast<byte>(Builtin::InternalBootProgramBase >> 16);
-    constexpr byte InternalPeripheralStart = static_cast<byte>(Builtin::InternalPeripheralBase >> 16);
-    constexpr byte InternalSRAMStart = static_cast<byte>(Builtin::InternalSRAMBase >> 16);
-    byte subOffset = static_cast<byte>(destination >> 16);
-    switch (subOffset) {
-        case BootProgramBaseStart:
+    switch (classifyInternalAddress(destination)) {
+        case InternalRegion::BootProgram:
             return readFromInternalBootProgram(static_cast<size_t>(destination - Builtin::InternalBootProgramBase));
-        case InternalSRAMStart:
-            if (auto offset = destination - InternalSRAMStart; offset < Builtin::InternalSRAMEnd) {
-                return internalSRAM_[static_cast<size_t>(offset)];
-            } else {
-                return loadFromBus(destination, TreatAsByteOrdinal{});
-            }
-        case InternalPeripheralStart:
-            if (destination >= Builtin::ConfigurationSpaceBaseAddress) {
-                return EEPROM.read(static_cast<int>(destination & 0xFFF));
-            } else {
-                /// @todo handle other devices
-                switch (auto offset = static_cast<byte>(destination); Builtin::addressToTargetPeripheral(destination))  {
-                    case Builtin::Devices::SPI:
-                        return SPIInterface::read(offset);
-                    case Builtin::Devices::Query:
-                        return QueryInterface::read(offset);
-                    case Builtin::Devices::IO:
-                        return GPIOInterface::read(offset);
-                    case Builtin::Devices::SerialConsole:
-                        return SerialConsole::read(offset);
-                    default:
-                        return loadFromBus(destination, TreatAsByteOrdinal{});
-                }
+        case InternalRegion::SRAM:
+            return internalSRAM_[static_cast<size_t>(destination - Builtin::InternalSRAMBase)];
+        case InternalRegion::ConfigurationSpace:
+            return bus_.readConfigurationSpace(destination);
+        case InternalRegion::Peripherals:
+            /// @todo handle other devices
+            switch (auto offset = static_cast<byte>(destination); Builtin::addressToTargetPeripheral(destination))  {
+#ifdef ARDUINO
+                case Builtin::Devices::SPI:
+                    return SPIInterface::read(offset);
+#endif
+                case Builtin::Devices::Query:
+                    return QueryInterface::read(*this, offset);
+                case Builtin::Devices::IO:
+                    return GPIOInterface::read(offset);
+                case Builtin::Devices::SerialConsole:
+                    return SerialConsole::read(offset);
+                case Builtin::Devices::DMA:
+                    return DMAEngine::read(offset);
+                default:
+                    return loadFromBus(destination, TreatAsByteOrdinal{});
             }
         default:
             return loadFromBus(destination, TreatAsByteOrdinal{});
@@ -349,40 +512,39 @@ Core::readFromInternalSpace(Address destination) noexcept {
 }
 void
 Core::writeToInternalSpace(Address destination, byte value) noexcept {
-    constexpr byte BootProgramBaseStart = static_cast<byte>(Builtin::InternalBootProgramBase >> 16);
-    constexpr byte InternalPeripheralStart = static_cast<byte>(Builtin::InternalPeripheralBase >> 16);
-    constexpr byte InternalSRAMStart = static_cast<byte>(Builtin::InternalSRAMBase >> 16);
-    byte subOffset = static_cast<byte>(destination >> 16);
-    switch (subOffset) {
-        case BootProgramBaseStart:
+    switch (classifyInternalAddress(destination)) {
+        case InternalRegion::BootProgram:
             // ignore writes made to this location
             break;
-        case InternalSRAMStart:
-            if (auto offset = destination - InternalSRAMStart; offset < Builtin::InternalSRAMEnd) {
-                internalSRAM_[static_cast<size_t>(offset)] = value;
-            } else {
-                storeToBus(destination, value, TreatAsByteOrdinal{});
-            }
+        case InternalRegion::SRAM:
+            internalSRAM_[static_cast<size_t>(destination - Builtin::InternalSRAMBase)] = value;
             break;
-        case InternalPeripheralStart:
-            if (destination >= Builtin::ConfigurationSpaceBaseAddress) {
-                EEPROM.update(static_cast<int>(destination & 0xFFF), value);
-            } else {
-                switch (auto offset = static_cast<byte>(destination); Builtin::addressToTargetPeripheral(destination))  {
-                    case Builtin::Devices::SPI:
-                        SPIInterface::write(offset, value);
-                        break;
-                    case Builtin::Devices::IO:
-                        GPIOInterface::write(offset, value);
-                        break;
-                    case Builtin::Devices::SerialConsole:
-                        SerialConsole::write(offset, value);
-                        break;
-                    default:
-                        storeToBus(destination, value, TreatAsByteOrdinal{});
-                        break;
+        case InternalRegion::ConfigurationSpace:
+            bus_.writeConfigurationSpace(destination, value);
+            break;
+        case InternalRegion::Peripherals:
+            switch (auto offset = static_cast<byte>(destination); Builtin::addressToTargetPeripheral(destination))  {
+#ifdef ARDUINO
+                case Builtin::Devices::SPI:
+                    SPIInterface::write(offset, value);
+                    break;
+#endif
+                case Builtin::Devices::Query:
+                    QueryInterface::write(*this, offset, value);
+                    break;
+                case Builtin::Devices::IO:
+                    GPIOInterface::write(offset, value);
+                    break;
+                case Builtin::Devices::SerialConsole:
+                    SerialConsole::write(offset, value);
+                    break;
+                case Builtin::Devices::DMA:
+                    DMAEngine::write(*this, offset, value);
+                    break;
+                default:
+                    storeToBus(destination, value, TreatAsByteOrdinal{});
+                    break;
 
-                }
             }
             break;
         default:
@@ -392,26 +554,40 @@ Core::writeToInternalSpace(Address destination, byte value) noexcept {
 }
 
 void
-Core::load(Address destination, TripleRegister& reg) noexcept {
-    for (int i = 0; i < 3; ++i, destination += sizeof(Ordinal)) {
-        reg.setOrdinal(load(destination), i);
+Core::transferBlock(BlockOperation operation, Address destination, Address source, Ordinal length) noexcept {
+    // staged through a small buffer so both sides can use their fastest path independently
+    constexpr Ordinal ChunkSize = 64;
+    byte buffer[ChunkSize];
+    if (operation == BlockOperation::Fill) {
+        memset(buffer, static_cast<byte>(source), ChunkSize);
     }
+    // a move onto an overlapping higher destination runs back to front so nothing is overwritten before it is read
+    bool backwards = operation == BlockOperation::Move && destination > source && (destination - source) < length;
+    for (Ordinal done = 0; done < length; ) {
+        auto count = (length - done) < ChunkSize ? (length - done) : ChunkSize;
+        auto offset = backwards ? (length - done - count) : done;
+        if (operation != BlockOperation::Fill) {
+            readBlock(source + offset, buffer, count);
+        }
+        writeBlock(destination + offset, buffer, count);
+        done += count;
+    }
+}
+void
+Core::load(Address destination, TripleRegister& reg) noexcept {
+    readBlock(destination, reinterpret_cast<byte*>(&reg), sizeof(Ordinal) * 3);
 }
 void
 Core::store(Address destination, const TripleRegister& reg) noexcept {
-    for (int i = 0; i < 3; ++i, destination += sizeof(Ordinal)) {
-        store(destination, reg.getOrdinal(i), TreatAsOrdinal{});
-    }
+    writeBlock(destination, reinterpret_cast<const byte*>(&reg), sizeof(Ordinal) * 3);
 }
 void
 Core::load(Address destination, QuadRegister& reg) noexcept {
-    reg.setLowerHalf(load(destination, TreatAsLongOrdinal{}));
-    reg.setUpperHalf(load(destination + sizeof(LongOrdinal), TreatAsLongOrdinal {}));
+    readBlock(destination, reinterpret_cast<byte*>(&reg), sizeof(QuadRegister));
 }
 void
 Core::store(Address destination, const QuadRegister& reg) noexcept {
-    store(destination, reg.getLowerHalf(), TreatAsLongOrdinal{});
-    store(destination+sizeof(LongOrdinal), reg.getUpperHalf(), TreatAsLongOrdinal{});
+    writeBlock(destination, reinterpret_cast<const byte*>(&reg), sizeof(QuadRegister));
 }
 QuadRegister
 Core::loadQuad(Address destination) noexcept {
@@ -423,6 +599,7 @@ void Core::synchronizedStore(Address destination, const DoubleRegister& value) n
     // there is a lookup for an interrupt control register, in the Sx manual, we are going to ignore that for now
     synchronizeMemoryRequests();
     storeLong(destination, value.get(TreatAsLongOrdinal{}));
+    writeBackDataCache(destination, sizeof(LongOrdinal));
 }
 void Core::synchronizedStore(Address destination, const QuadRegister& value) noexcept {
     synchronizeMemoryRequests();
@@ -433,6 +610,7 @@ void Core::synchronizedStore(Address destination, const QuadRegister& value) noe
     } else {
         // synchronized stores are always aligned but still go through the normal mechanisms
         store(destination, value);
+        writeBackDataCache(destination, sizeof(QuadRegister));
     }
 }
 void Core::synchronizedStore(Address destination, const Register& value) noexcept {
@@ -445,19 +623,6 @@ void Core::synchronizedStore(Address destination, const Register& value) noexcep
         }
     } else {
         store(destination, value.get<Ordinal>());
-    }
-}
-
-void
-Core::setEBIUpper(Address address) noexcept {
-    static constexpr Address upperMask = 0xFFFF'8000;
-    static constexpr Address bit15Mask = 0x0000'8000;
-    auto realAddress = address & upperMask;
-    if (realAddress != ebiUpper_) {
-        // set our fake A15
-        digitalWrite(Pinout::EBI_A15, bit15Mask & realAddress ? HIGH : LOW);
-        PORTL = static_cast<byte>(address >> 16);
-        PORTK = static_cast<byte>(address >> 24);
-        ebiUpper_ = realAddress;
+        writeBackDataCache(destination, sizeof(Ordinal));
     }
 }
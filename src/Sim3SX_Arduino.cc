@@ -28,11 +28,15 @@
 #include "Core.h"
 #include <Arduino.h>
 Core theCore;
+/**
+ * @brief How many instructions to execute before handing control back to the arduino runtime
+ */
+constexpr size_t InstructionsPerLoop = 1024;
 void setup() {
     theCore.begin();
 }
 void loop() {
-    theCore.cycle();
+    theCore.run(InstructionsPerLoop);
 }
 #if __cplusplus >= 201402L
 #ifdef ARDUINO_AVR_MEGA2560
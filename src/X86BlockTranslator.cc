@@ -0,0 +1,208 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// x86-64 encodings for the handful of instructions the block translator emits
+//
+#ifdef HOST_JIT
+#include <sys/mman.h>
+#include "X86BlockTranslator.h"
+
+X86BlockTranslator::X86BlockTranslator() noexcept {
+    auto memory = mmap(nullptr, ArenaSize, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    // some hardened kernels refuse writable and executable mappings, just stay in the interpreter in that case
+    arena_ = memory == MAP_FAILED ? nullptr : reinterpret_cast<byte*>(memory);
+}
+X86BlockTranslator::~X86BlockTranslator() {
+    if (arena_) {
+        munmap(arena_, ArenaSize);
+    }
+}
+X86BlockTranslator::Entry
+X86BlockTranslator::begin() noexcept {
+    // keep the start of each block 16 byte aligned
+    while ((position_ & 0xF) != 0) {
+        emit(0xCC); // int3
+    }
+    auto entry = reinterpret_cast<Entry>(arena_ + position_);
+    emit(0x53); // push rbx
+    emit(0x41); emit(0x54); // push r12
+    emit(0x41); emit(0x55); // push r13
+    emit(0x41); emit(0x56); // push r14
+    emit(0x41); emit(0x57); // push r15 ; five pushes leave the stack aligned for the fallback calls
+    emit(0x48); emit(0x89); emit(0xFB); // mov rbx, rdi
+    emit(0x49); emit(0x89); emit(0xF4); // mov r12, rsi
+    emit(0x49); emit(0x89); emit(0xD5); // mov r13, rdx
+    emit(0x49); emit(0x89); emit(0xCE); // mov r14, rcx
+    emit(0x4D); emit(0x89); emit(0xC7); // mov r15, r8
+    return entry;
+}
+void
+X86BlockTranslator::emitReturn(Ordinal executed) noexcept {
+    emit(0xB8); emitValue<Ordinal>(executed); // mov eax, executed
+    emit(0x41); emit(0x5F); // pop r15
+    emit(0x41); emit(0x5E); // pop r14
+    emit(0x41); emit(0x5D); // pop r13
+    emit(0x41); emit(0x5C); // pop r12
+    emit(0x5B); // pop rbx
+    emit(0xC3); // ret
+}
+void
+X86BlockTranslator::loadRegister(Scratch dest, Base base, byte index) noexcept {
+    // mov e(a|c)x, [r12/r13 + disp8]
+    byte reg = dest == Scratch::EAX ? 0b000 : 0b001;
+    emit(0x41);
+    emit(0x8B);
+    if (base == Base::Locals) {
+        emit(0b01'000'100 | (reg << 3)); // r12 needs a SIB byte
+        emit(0x24);
+    } else {
+        emit(0b01'000'101 | (reg << 3));
+    }
+    emit(static_cast<byte>(index * sizeof(Register)));
+}
+void
+X86BlockTranslator::loadImmediate(Scratch dest, Ordinal value) noexcept {
+    emit(dest == Scratch::EAX ? 0xB8 : 0xB9);
+    emitValue<Ordinal>(value);
+}
+void
+X86BlockTranslator::storeRegister(Base base, byte index) noexcept {
+    // mov [r12/r13 + disp8], eax
+    emit(0x41);
+    emit(0x89);
+    if (base == Base::Locals) {
+        emit(0b01'000'100);
+        emit(0x24);
+    } else {
+        emit(0b01'000'101);
+    }
+    emit(static_cast<byte>(index * sizeof(Register)));
+}
+void
+X86BlockTranslator::combine(Operation op) noexcept {
+    switch (op) {
+        case Operation::Add: emit(0x01); emit(0xC8); break; // add eax, ecx
+        case Operation::Subtract: emit(0x29); emit(0xC8); break; // sub eax, ecx
+        case Operation::Multiply: emit(0x0F); emit(0xAF); emit(0xC1); break; // imul eax, ecx
+        case Operation::And: emit(0x21); emit(0xC8); break; // and eax, ecx
+        case Operation::Or: emit(0x09); emit(0xC8); break; // or eax, ecx
+        case Operation::Xor: emit(0x31); emit(0xC8); break; // xor eax, ecx
+    }
+}
+void
+X86BlockTranslator::invert(Scratch target) noexcept {
+    emit(0xF7);
+    emit(target == Scratch::EAX ? 0xD0 : 0xD1); // not eax/ecx
+}
+void
+X86BlockTranslator::shift(bool left) noexcept {
+    emit(0x31); emit(0xD2); // xor edx, edx
+    emit(0xD3); emit(left ? 0xE0 : 0xE8); // shl/shr eax, cl
+    emit(0x83); emit(0xF9); emit(0x20); // cmp ecx, 32
+    emit(0x0F); emit(0x43); emit(0xC2); // cmovae eax, edx
+}
+void
+X86BlockTranslator::shiftLeft(Scratch target, byte amount) noexcept {
+    emit(0xC1); emit(target == Scratch::EAX ? 0xE0 : 0xE1); emit(amount); // shl eax/ecx, amount
+}
+void
+X86BlockTranslator::guardAccess(const AccessGuard& guard, byte width, bool store, ForwardJumps& slow) noexcept {
+    auto jumpToSlow = [this, &slow](byte condition) noexcept {
+        emit(0x0F); emit(condition); emitValue<Ordinal>(0); // jcc rel32, patched by bind
+        slow.sites_[slow.count_++] = position_;
+    };
+    emit(0x3D); emitValue<Ordinal>(guard.limit_ - (width - 1)); // cmp eax, limit
+    jumpToSlow(0x83); // jae
+    // the same wrapping overlap test writeBackStaleFrame does: (address + width - 1 - fp) < 64 + width - 1
+    emit(0x8D); emit(0x50); emit(width - 1); // lea edx, [rax + width - 1]
+    emit(0x2B); emit(0x93); emitValue<int32_t>(guard.staleFramePointer_); // sub edx, [rbx + stale frame pointer]
+    emit(0x83); emit(0xFA); emit(static_cast<byte>(RegisterFrame::Size + (width - 1))); // cmp edx, 64 + width - 1
+    jumpToSlow(0x82); // jb
+    if (store) {
+        emit(0x3B); emit(0x83); emitValue<int32_t>(guard.codeHighest_); // cmp eax, [rbx + highest]
+        emit(0x77); emit(0); // ja over the second half
+        auto patch = position_;
+        emit(0x8D); emit(0x50); emit(width - 1); // lea edx, [rax + width - 1]
+        emit(0x3B); emit(0x93); emitValue<int32_t>(guard.codeLowest_); // cmp edx, [rbx + lowest]
+        jumpToSlow(0x83); // jae
+        arena_[patch - 1] = static_cast<byte>(position_ - patch);
+    }
+}
+void
+X86BlockTranslator::loadMemory(byte width) noexcept {
+    switch (width) {
+        case 1: emit(0x41); emit(0x0F); emit(0xB6); break; // movzx eax, byte [r15 + rax]
+        case 2: emit(0x41); emit(0x0F); emit(0xB7); break; // movzx eax, word [r15 + rax]
+        default: emit(0x41); emit(0x8B); break; // mov eax, [r15 + rax]
+    }
+    emit(0x04); emit(0x07);
+}
+void
+X86BlockTranslator::storeMemory(byte width) noexcept {
+    switch (width) {
+        case 1: emit(0x41); emit(0x88); break; // mov [r15 + rax], cl
+        case 2: emit(0x66); emit(0x41); emit(0x89); break; // mov [r15 + rax], cx
+        default: emit(0x41); emit(0x89); break; // mov [r15 + rax], ecx
+    }
+    emit(0x0C); emit(0x07);
+}
+void
+X86BlockTranslator::jumpForward(ForwardJumps& jumps) noexcept {
+    emit(0xE9); emitValue<Ordinal>(0); // jmp rel32, patched by bind
+    jumps.sites_[jumps.count_++] = position_;
+}
+void
+X86BlockTranslator::bind(ForwardJumps& jumps) noexcept {
+    for (byte i = 0; i < jumps.count_; ++i) {
+        auto site = jumps.sites_[i];
+        auto displacement = static_cast<Ordinal>(position_ - site);
+        for (size_t j = 0; j < sizeof(Ordinal); ++j) {
+            arena_[site - sizeof(Ordinal) + j] = static_cast<byte>(displacement >> (j * 8));
+        }
+    }
+    jumps.count_ = 0;
+}
+void
+X86BlockTranslator::fallback(Fallback function, void* core, const void* instruction, Ordinal dispatch, Address address, void* block, Address blockAddress, Ordinal executedSoFar) noexcept {
+    (void)core; // the core is already in rbx
+    emit(0x48); emit(0x89); emit(0xDF); // mov rdi, rbx
+    emit(0x48); emit(0xBE); emitValue(reinterpret_cast<uintptr_t>(instruction)); // mov rsi, imm64
+    emit(0xBA); emitValue<Ordinal>(dispatch); // mov edx, imm32
+    emit(0xB9); emitValue<Ordinal>(address); // mov ecx, imm32
+    emit(0x49); emit(0xB8); emitValue(reinterpret_cast<uintptr_t>(block)); // mov r8, imm64
+    emit(0x41); emit(0xB9); emitValue<Ordinal>(blockAddress); // mov r9d, imm32
+    emit(0x48); emit(0xB8); emitValue(reinterpret_cast<uintptr_t>(function)); // mov rax, imm64
+    emit(0xFF); emit(0xD0); // call rax
+    emit(0x84); emit(0xC0); // test al, al
+    // jnz over the early exit
+    emit(0x75); emit(0);
+    auto patch = position_;
+    emitReturn(executedSoFar);
+    arena_[patch - 1] = static_cast<byte>(position_ - patch);
+}
+void
+X86BlockTranslator::finish(Address nextIP, Ordinal executed) noexcept {
+    emit(0x41); emit(0xC7); emit(0x06); emitValue<Ordinal>(nextIP); // mov dword [r14], nextIP
+    emitReturn(executed);
+}
+#endif
@@ -0,0 +1,141 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Everything the host side guest program runners (the microbenchmarks and the behaviour checks) share: the memory map,
+// the processor tables and the sequence a program ends with
+//
+#ifndef SIM_ECORE_GUESTHARNESS_H
+#define SIM_ECORE_GUESTHARNESS_H
+#include "Core.h"
+#include "InstructionEncoder.h"
+
+namespace GuestHarness {
+    using namespace Encoder;
+    // memory map shared by every guest program
+    constexpr Address SystemAddressTableBase = 0x0100;
+    constexpr Address PRCBBase = 0x0200;
+    constexpr Address SystemProcedureTableBase = 0x0300;
+    constexpr Address FaultProcedureTableBase = 0x0400;
+    constexpr Address InterruptTableBase = 0x0500;
+    constexpr Address DoneFlag = 0x0700;
+    /**
+     * @brief g13 is stored here just before the done flag, programs accumulate whatever they want checked into it
+     */
+    constexpr Address ResultWord = 0x0704;
+    /**
+     * @brief How many times the spin loop a program ends in has gone around
+     */
+    constexpr Address SpinCount = 0x0708;
+    constexpr Address CodeBase = 0x1000;
+    constexpr Address DataBase = 0x4000;
+    constexpr Address InterruptStackBase = 0x1'0000;
+    /**
+     * @brief Instructions in one trip around the spin loop
+     */
+    constexpr size_t SpinLength = 4;
+
+    inline void
+    installWord(Core& core, Address address, Ordinal value) noexcept {
+        core.getBus().install(address, &value, sizeof(value));
+    }
+    /**
+     * @brief Lay down the boot record and the processor tables every program shares, plus a word pattern at DataBase
+     * (the word at offset i holds i * 0x01010101)
+     * @param procedureZero Entry zero of the system procedure table, a local procedure
+     */
+    inline void
+    installSystemTables(Core& core, Address procedureZero) noexcept {
+        installWord(core, 0x0, SystemAddressTableBase);
+        installWord(core, 0x4, PRCBBase);
+        installWord(core, 0xC, CodeBase);
+        installWord(core, SystemAddressTableBase + 120, SystemProcedureTableBase);
+        installWord(core, SystemAddressTableBase + 152, FaultProcedureTableBase);
+        installWord(core, PRCBBase + 20, InterruptTableBase);
+        installWord(core, PRCBBase + 24, InterruptStackBase);
+        // entry zero is a local procedure (type 0b00)
+        installWord(core, SystemProcedureTableBase + 48, procedureZero);
+        for (Address i = 0; i < 0x400; i += 4) {
+            installWord(core, DataBase + i, i * 0x0101'0101);
+        }
+    }
+    /**
+     * @brief Store g13 to ResultWord, raise the done flag and then spin in place counting trips around the loop in g14.
+     * Every store is followed by a syncf so the runner sees it on the bus past any cache.
+     */
+    inline void
+    finish(Program& p) noexcept {
+        p.emit(mema(Opcode::st, g(13), ResultWord));
+        p.emit(mema(Opcode::lda, g(14), 0));
+        p.emit(mema(Opcode::lda, r(3), 1));
+        p.emit(mema(Opcode::st, r(3), DoneFlag));
+        p.emit(reg(Opcode::syncf, r(0), r(0), r(0)));
+        // end the block here so the spin loop is always a block of its own
+        auto spin = p.here() + 4;
+        p.branch(Opcode::b, spin);
+        p.emit(reg(Opcode::addo, lit(1), g(14), g(14)));
+        p.emit(mema(Opcode::st, g(14), SpinCount));
+        p.emit(reg(Opcode::syncf, r(0), r(0), r(0)));
+        p.branch(Opcode::b, spin);
+    }
+    /**
+     * @brief Copy the program into guest memory along with the system tables and boot the core; procedure zero is put
+     * right after the program and adds one to g13
+     */
+    inline void
+    install(Core& core, Program& program) noexcept {
+        auto procedureZero = program.here();
+        program.emit(reg(Opcode::addo, lit(1), g(13), g(13)));
+        program.emit(ctrl(Opcode::ret, 0));
+        core.getBus().install(program.base(), program.words().data(), program.words().size() * sizeof(Ordinal));
+        installSystemTables(core, procedureZero);
+        core.boot(0);
+    }
+    struct Completion {
+        /**
+         * @brief Instructions executed up to the done flag, the spin loop after it is not included
+         */
+        size_t instructions;
+        bool finished;
+    };
+    /**
+     * @brief Run the core until the program raises the done flag or the instruction limit is used up
+     */
+    inline Completion
+    runUntilDone(Core& core, size_t instructionLimit) noexcept {
+        constexpr size_t InstructionsPerCheck = 1024;
+        size_t executed = 0;
+        while (core.getBus().load(DoneFlag, TreatAsOrdinal{}) == 0) {
+            if (executed >= instructionLimit) {
+                return { executed, false };
+            }
+            executed += core.run(InstructionsPerCheck);
+        }
+        // run only stops between blocks and the spin loop is one block, so every trip around it has been counted
+        return { executed - (SpinLength * core.getBus().load(SpinCount, TreatAsOrdinal{})), true };
+    }
+    [[nodiscard]] inline Ordinal
+    result(Core& core) noexcept {
+        return core.getBus().load(ResultWord, TreatAsOrdinal{});
+    }
+}
+#endif //SIM_ECORE_GUESTHARNESS_H
@@ -0,0 +1,133 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// constexpr encoders for the i960 instruction formats, enough to hand assemble small programs on the host without a
+// cross toolchain. Field layouts match the bitfields in Instruction.h
+//
+#ifndef SIM_ECORE_INSTRUCTIONENCODER_H
+#define SIM_ECORE_INSTRUCTIONENCODER_H
+#include <vector>
+#include "Instruction.h"
+
+namespace Encoder {
+    /**
+     * @brief A register or literal operand; registers are numbered like RegisterIndex (r0-r15 then g0-g15)
+     */
+    struct Operand {
+        byte value;
+        bool literal;
+    };
+    constexpr Operand r(byte index) noexcept { return { static_cast<byte>(index & 0b1111), false }; }
+    constexpr Operand g(byte index) noexcept { return { static_cast<byte>(16 + (index & 0b1111)), false }; }
+    constexpr Operand lit(byte value) noexcept { return { static_cast<byte>(value & 0b11111), true }; }
+
+    constexpr Ordinal reg(Opcode op, Operand src1, Operand src2, Operand srcDest) noexcept {
+        auto opcode = static_cast<FullOpcode>(op);
+        return (static_cast<Ordinal>(opcode >> 4) << 24) |
+               (static_cast<Ordinal>(srcDest.value) << 19) |
+               (static_cast<Ordinal>(src2.value) << 14) |
+               (static_cast<Ordinal>(srcDest.literal) << 13) |
+               (static_cast<Ordinal>(src2.literal) << 12) |
+               (static_cast<Ordinal>(src1.literal) << 11) |
+               (static_cast<Ordinal>(opcode & 0xF) << 7) |
+               static_cast<Ordinal>(src1.value);
+    }
+    /**
+     * @param displacement Byte offset from the address of the COBR instruction itself
+     */
+    constexpr Ordinal cobr(Opcode opcode, Operand src1, Operand src2, Integer displacement) noexcept {
+        return (static_cast<Ordinal>(opcode) << 24) |
+               (static_cast<Ordinal>(src1.value) << 19) |
+               (static_cast<Ordinal>(src2.value) << 14) |
+               (static_cast<Ordinal>(src1.literal) << 13) |
+               (static_cast<Ordinal>(displacement) & 0x1FFC);
+    }
+    /**
+     * @param displacement Byte offset from the address of the CTRL instruction itself
+     */
+    constexpr Ordinal ctrl(Opcode opcode, Integer displacement) noexcept {
+        return (static_cast<Ordinal>(opcode) << 24) | (static_cast<Ordinal>(displacement) & 0xFF'FFFC);
+    }
+    constexpr Ordinal mema(Opcode opcode, Operand srcDest, Ordinal offset) noexcept {
+        return (static_cast<Ordinal>(opcode) << 24) | (static_cast<Ordinal>(srcDest.value) << 19) | (offset & 0xFFF);
+    }
+    constexpr Ordinal mema(Opcode opcode, Operand srcDest, Operand abase, Ordinal offset) noexcept {
+        return mema(opcode, srcDest, offset) | (static_cast<Ordinal>(abase.value) << 14) | (0b10 << 12);
+    }
+    /**
+     * @brief The first word of a MEMB instruction, double wide modes are followed by the 32-bit displacement
+     */
+    constexpr Ordinal memb(Opcode opcode, Operand srcDest, MEMFormatMode mode, Operand abase, Operand index = r(0), byte scale = 0) noexcept {
+        return (static_cast<Ordinal>(opcode) << 24) |
+               (static_cast<Ordinal>(srcDest.value) << 19) |
+               (static_cast<Ordinal>(abase.value) << 14) |
+               (static_cast<Ordinal>(mode) << 10) |
+               (static_cast<Ordinal>(scale & 0b111) << 7) |
+               static_cast<Ordinal>(index.value);
+    }
+    // addo 1, g0, g0
+    static_assert(reg(Opcode::addo, lit(1), g(0), g(0)) == 0x5984'0801);
+    // cmpobne 0, g0, .-8
+    static_assert(cobr(Opcode::cmpobne, lit(0), g(0), -8) == 0x3504'3FF8);
+    // lda 0x700, r3
+    static_assert(mema(Opcode::lda, r(3), 0x700) == 0x8C18'0700);
+
+    /**
+     * @brief Accumulates encoded words for a program which will be installed at a known base address
+     */
+    class Program {
+    public:
+        explicit Program(Address base) noexcept : base_(base) { }
+        [[nodiscard]] Address here() const noexcept { return base_ + static_cast<Address>(words_.size() * sizeof(Ordinal)); }
+        [[nodiscard]] Address base() const noexcept { return base_; }
+        void emit(Ordinal word) noexcept { words_.emplace_back(word); }
+        void emit(Ordinal word, Integer displacement) noexcept {
+            emit(word);
+            emit(static_cast<Ordinal>(displacement));
+        }
+        /**
+         * @brief Emit a relative branch to the given target
+         */
+        void branch(Opcode opcode, Address target) noexcept { emit(ctrl(opcode, static_cast<Integer>(target - here()))); }
+        void compareAndBranch(Opcode opcode, Operand src1, Operand src2, Address target) noexcept {
+            emit(cobr(opcode, src1, src2, static_cast<Integer>(target - here())));
+        }
+        /**
+         * @brief Fix up the displacement of a branch emitted before its target was known
+         */
+        void patch(Address location, Address target) noexcept {
+            auto& word = words_[(location - base_) / sizeof(Ordinal)];
+            auto displacement = static_cast<Ordinal>(target - location);
+            if (isCTRLFormat(static_cast<uint8_t>(word >> 24))) {
+                word = (word & 0xFF00'0000) | (displacement & 0xFF'FFFC);
+            } else {
+                word = (word & ~static_cast<Ordinal>(0x1FFC)) | (displacement & 0x1FFC);
+            }
+        }
+        [[nodiscard]] const std::vector<Ordinal>& words() const noexcept { return words_; }
+    private:
+        Address base_;
+        std::vector<Ordinal> words_;
+    };
+}
+#endif //SIM_ECORE_INSTRUCTIONENCODER_H
@@ -0,0 +1,401 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Microbenchmark runner for the host build. Each benchmark is a small hand assembled program (tests/benchmarks.s lists
+// what each one reads as in assembly) which is booted through Core::boot and timed until it signals completion. Every
+// program also leaves a result in guest memory which is checked against what it should have computed, the runner exits
+// non-zero when any of them is wrong.
+//
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include "GuestHarness.h"
+
+namespace {
+    using namespace GuestHarness;
+    using Mode = MEMFormatMode;
+    constexpr Ordinal DefaultIterations = 200'000;
+    /**
+     * @brief Each benchmark body is repeated this many times per loop iteration so that the loop overhead stays small
+     */
+    constexpr int Unroll = 8;
+
+    /**
+     * @brief g0 is the loop counter for every benchmark and g13 holds the result it is checked against
+     * @return The address of the top of the loop
+     */
+    Address
+    beginLoop(Program& p, Ordinal iterations) noexcept {
+        p.emit(mema(Opcode::lda, g(13), 0));
+        p.emit(memb(Opcode::lda, g(0), Mode::MEMB_AbsoluteDisplacement, r(0)), static_cast<Integer>(iterations));
+        return p.here();
+    }
+    void
+    closeLoop(Program& p, Address loop) noexcept {
+        p.emit(reg(Opcode::subo, lit(1), g(0), g(0)));
+        p.compareAndBranch(Opcode::cmpobne, lit(0), g(0), loop);
+    }
+    /**
+     * @brief Close the loop and hand the result back to the runner
+     */
+    void
+    endLoop(Program& p, Address loop) noexcept {
+        closeLoop(p, loop);
+        finish(p);
+    }
+    /**
+     * @brief Add a register into the result once per loop iteration
+     */
+    void
+    accumulate(Program& p, Encoder::Operand value) noexcept {
+        p.emit(reg(Opcode::addo, value, g(13), g(13)));
+    }
+    template<typename F>
+    void
+    unrolled(Program& p, F body) noexcept {
+        for (int i = 0; i < Unroll; ++i) {
+            body(p);
+        }
+    }
+    constexpr Ordinal WordIndex = 3;
+    constexpr Ordinal OperandA = 0x1234'5678;
+    constexpr Ordinal OperandB = 0x35;
+    void
+    loadBases(Program& p) noexcept {
+        // g1 = data base, g2 = word index, g3/g4 = operands
+        p.emit(memb(Opcode::lda, g(1), Mode::MEMB_AbsoluteDisplacement, r(0)), DataBase);
+        p.emit(mema(Opcode::lda, g(2), WordIndex));
+        p.emit(memb(Opcode::lda, g(3), Mode::MEMB_AbsoluteDisplacement, r(0)), OperandA);
+        p.emit(mema(Opcode::lda, g(4), OperandB));
+    }
+    void
+    regArithmetic(Program& p, Ordinal iterations) noexcept {
+        loadBases(p);
+        auto loop = beginLoop(p, iterations);
+        unrolled(p, [](Program& p) {
+            p.emit(reg(Opcode::addo, g(4), g(3), r(4)));
+            p.emit(reg(Opcode::subo, lit(7), r(4), r(5)));
+            p.emit(reg(Opcode::mulo, g(4), r(5), r(6)));
+            p.emit(reg(Opcode::addi, lit(3), r(6), r(7)));
+            p.emit(reg(Opcode::divo, g(4), r(7), r(8)));
+            p.emit(reg(Opcode::remo, lit(9), r(7), r(9)));
+            p.emit(reg(Opcode::shlo, lit(3), r(9), r(10)));
+            p.emit(reg(Opcode::shro, lit(1), r(10), r(11)));
+        });
+        accumulate(p, r(8));
+        accumulate(p, r(11));
+        endLoop(p, loop);
+    }
+    Ordinal
+    regArithmeticResult(Ordinal iterations) noexcept {
+        Ordinal r7 = ((OperandA + OperandB) - 7) * OperandB + 3;
+        return iterations * ((r7 / OperandB) + (((r7 % 9) << 3) >> 1));
+    }
+    void
+    logical(Program& p, Ordinal iterations) noexcept {
+        loadBases(p);
+        auto loop = beginLoop(p, iterations);
+        unrolled(p, [](Program& p) {
+            p.emit(reg(Opcode::logicalAnd, g(4), g(3), r(4)));
+            p.emit(reg(Opcode::logicalOr, lit(6), r(4), r(5)));
+            p.emit(reg(Opcode::logicalXor, g(3), r(5), r(6)));
+            p.emit(reg(Opcode::logicalNot, r(6), r(0), r(7)));
+            p.emit(reg(Opcode::andnot, r(7), g(3), r(8)));
+            p.emit(reg(Opcode::logicalNor, r(8), g(4), r(9)));
+            p.emit(reg(Opcode::logicalXnor, r(9), r(6), r(10)));
+            p.emit(reg(Opcode::mov, r(10), r(0), r(11)));
+        });
+        accumulate(p, r(8));
+        accumulate(p, r(11));
+        endLoop(p, loop);
+    }
+    Ordinal
+    logicalResult(Ordinal iterations) noexcept {
+        Ordinal r6 = ((OperandA & OperandB) | 6) ^ OperandA;
+        Ordinal r8 = OperandA & r6;
+        Ordinal r9 = ~(r8 | OperandB);
+        return iterations * (r8 + ~(r9 ^ r6));
+    }
+    void
+    bitOperations(Program& p, Ordinal iterations) noexcept {
+        loadBases(p);
+        auto loop = beginLoop(p, iterations);
+        unrolled(p, [](Program& p) {
+            p.emit(reg(Opcode::setbit, lit(5), g(3), r(4)));
+            p.emit(reg(Opcode::clrbit, lit(4), r(4), r(5)));
+            p.emit(reg(Opcode::notbit, lit(31), r(5), r(6)));
+            p.emit(reg(Opcode::alterbit, lit(2), r(6), r(7)));
+            p.emit(reg(Opcode::chkbit, lit(3), r(7), r(0)));
+            p.emit(reg(Opcode::scanbit, r(7), r(0), r(8)));
+            p.emit(reg(Opcode::spanbit, r(7), r(0), r(9)));
+            p.emit(reg(Opcode::extract, lit(4), lit(8), r(9)));
+        });
+        accumulate(p, r(6));
+        accumulate(p, r(8));
+        accumulate(p, r(9));
+        endLoop(p, loop);
+    }
+    Ordinal
+    bitOperationsResult(Ordinal iterations) noexcept {
+        Ordinal r6 = ((OperandA | (1u << 5)) & ~(1u << 4)) ^ (1u << 31);
+        // bit 31 is set and bit 30 is the highest clear bit whatever alterbit did to bit 2, extract then leaves 30 >> 4
+        return iterations * (r6 + 31 + (30 >> 4));
+    }
+    void
+    compareAndBranch(Program& p, Ordinal iterations) noexcept {
+        loadBases(p);
+        auto loop = beginLoop(p, iterations);
+        unrolled(p, [](Program& p) {
+            // alternate taken and not taken, every branch skips an increment of the result
+            auto skipIncrement = [&p](Opcode opcode, Encoder::Operand src1) {
+                p.compareAndBranch(opcode, src1, g(2), p.here() + 8);
+                accumulate(p, lit(1));
+            };
+            skipIncrement(Opcode::cmpobe, lit(3));
+            skipIncrement(Opcode::cmpobne, lit(3));
+            skipIncrement(Opcode::cmpibl, lit(2));
+            skipIncrement(Opcode::cmpibg, lit(2));
+            skipIncrement(Opcode::bbs, lit(0));
+            skipIncrement(Opcode::bbc, lit(0));
+        });
+        endLoop(p, loop);
+    }
+    Ordinal
+    compareAndBranchResult(Ordinal iterations) noexcept {
+        // cmpobne, cmpibg and bbc fall through
+        return iterations * Unroll * 3;
+    }
+    /**
+     * @brief Every memory benchmark stores this and loads it back from the same address
+     */
+    constexpr Ordinal StoredWord = 0x600D'F00D;
+    /**
+     * @brief Load and store a word using a single addressing mode
+     */
+    template<Mode mode>
+    void
+    memoryAccess(Program& p, Ordinal iterations) noexcept {
+        loadBases(p);
+        p.emit(memb(Opcode::lda, r(5), Mode::MEMB_AbsoluteDisplacement, r(0)), static_cast<Integer>(StoredWord));
+        auto loop = beginLoop(p, iterations);
+        unrolled(p, [](Program& p) {
+            for (auto opcode : { Opcode::ld, Opcode::st }) {
+                auto value = opcode == Opcode::ld ? r(4) : r(5);
+                switch (mode) {
+                    case Mode::MEMA_AbsoluteOffset:
+                        p.emit(mema(opcode, value, 0x800));
+                        break;
+                    case Mode::MEMA_RegisterIndirectWithOffset:
+                        p.emit(mema(opcode, value, g(1), 0x10));
+                        break;
+                    case Mode::MEMB_RegisterIndirect:
+                        p.emit(memb(opcode, value, mode, g(1)));
+                        break;
+                    case Mode::MEMB_RegisterIndirectWithIndex:
+                        p.emit(memb(opcode, value, mode, g(1), g(2), 2));
+                        break;
+                    case Mode::MEMB_IPWithDisplacement:
+                        // the displacement is relative to the address of the instruction plus eight
+                        p.emit(memb(opcode, value, mode, r(0)), static_cast<Integer>(DataBase - (p.here() + 8)));
+                        break;
+                    case Mode::MEMB_AbsoluteDisplacement:
+                        p.emit(memb(opcode, value, mode, r(0)), DataBase + 0x20);
+                        break;
+                    case Mode::MEMB_RegisterIndirectWithDisplacement:
+                        p.emit(memb(opcode, value, mode, g(1)), 0x24);
+                        break;
+                    case Mode::MEMB_IndexWithDisplacement:
+                        p.emit(memb(opcode, value, mode, r(0), g(2), 2), DataBase);
+                        break;
+                    case Mode::MEMB_RegisterIndirectWithIndexAndDisplacement:
+                        p.emit(memb(opcode, value, mode, g(1), g(2), 2), 0x40);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        });
+        accumulate(p, r(4));
+        endLoop(p, loop);
+    }
+    Ordinal
+    memoryAccessResult(Ordinal iterations) noexcept {
+        return iterations * StoredWord;
+    }
+    /**
+     * @brief Recurse to a fixed depth, deeper than the four register frames the real chip keeps so that spills and fills
+     * are included unless NUM_REGISTER_FRAMES is raised past it
+     */
+    constexpr byte CallDepth = 8;
+    /**
+     * @brief Each level keeps its depth in a local and adds it to the result on the way back out, so a frame that does
+     * not come back intact from a spill shows up in the result
+     */
+    void
+    callReturn(Program& p, Ordinal iterations) noexcept {
+        auto loop = beginLoop(p, iterations);
+        p.emit(mema(Opcode::lda, g(5), CallDepth));
+        auto call = p.here();
+        p.emit(ctrl(Opcode::call, 0));
+        endLoop(p, loop);
+        auto function = p.here();
+        p.patch(call, function);
+        p.emit(reg(Opcode::subo, lit(1), g(5), g(5)));
+        p.emit(reg(Opcode::mov, g(5), r(0), r(4)));
+        auto unwind = p.here();
+        p.emit(cobr(Opcode::cmpobe, lit(0), g(5), 0));
+        p.branch(Opcode::call, function);
+        p.patch(unwind, p.here());
+        accumulate(p, r(4));
+        p.emit(reg(Opcode::addo, lit(1), g(5), g(5)));
+        p.emit(ctrl(Opcode::ret, 0));
+    }
+    Ordinal
+    callReturnResult(Ordinal iterations) noexcept {
+        // the levels hold CallDepth - 1 down to zero
+        return iterations * ((CallDepth * (CallDepth - 1)) / 2);
+    }
+    /**
+     * @brief calls through entry zero of the system procedure table to a local procedure that just increments the result
+     */
+    void
+    systemCall(Program& p, Ordinal iterations) noexcept {
+        auto loop = beginLoop(p, iterations);
+        unrolled(p, [](Program& p) {
+            p.emit(reg(Opcode::calls, lit(0), r(0), r(0)));
+        });
+        endLoop(p, loop);
+    }
+    Ordinal
+    systemCallResult(Ordinal iterations) noexcept {
+        return iterations * Unroll;
+    }
+    /**
+     * @brief synmov to ordinary memory followed by a store system base IAC through synmovq
+     */
+    void
+    synchronousMove(Program& p, Ordinal iterations) noexcept {
+        loadBases(p);
+        // the IAC message lives at DataBase + 0x100: type 0x80 (store system base) with field 3 pointing at DataBase + 0x200
+        p.emit(memb(Opcode::lda, g(5), Mode::MEMB_AbsoluteDisplacement, r(0)), DataBase + 0x100);
+        p.emit(memb(Opcode::lda, g(6), Mode::MEMB_AbsoluteDisplacement, r(0)), static_cast<Integer>(0xFF00'0010));
+        p.emit(memb(Opcode::lda, g(7), Mode::MEMB_AbsoluteDisplacement, r(0)), DataBase + 0x80);
+        p.emit(memb(Opcode::lda, r(4), Mode::MEMB_AbsoluteDisplacement, r(0)), static_cast<Integer>(0x8000'0000));
+        p.emit(memb(Opcode::st, r(4), Mode::MEMB_AbsoluteDisplacement, r(0)), DataBase + 0x100);
+        p.emit(memb(Opcode::lda, r(4), Mode::MEMB_AbsoluteDisplacement, r(0)), DataBase + 0x200);
+        p.emit(memb(Opcode::st, r(4), Mode::MEMB_AbsoluteDisplacement, r(0)), DataBase + 0x104);
+        auto loop = beginLoop(p, iterations);
+        unrolled(p, [](Program& p) {
+            p.emit(reg(Opcode::synmov, g(7), g(1), r(0)));
+            p.emit(reg(Opcode::synmovq, g(6), g(5), r(0)));
+        });
+        closeLoop(p, loop);
+        // add up the word synmov copied (word zero of the pattern) and the two bases the IAC stored
+        for (auto offset : { 0x80, 0x200, 0x204 }) {
+            p.emit(memb(Opcode::ld, r(4), Mode::MEMB_AbsoluteDisplacement, r(0)), DataBase + offset);
+            accumulate(p, r(4));
+        }
+        finish(p);
+    }
+    Ordinal
+    synchronousMoveResult(Ordinal) noexcept {
+        return SystemAddressTableBase + PRCBBase;
+    }
+    struct Benchmark {
+        const char* name;
+        void (*build)(Program&, Ordinal);
+        /**
+         * @brief What the program leaves in ResultWord for a given iteration count
+         */
+        Ordinal (*expected)(Ordinal);
+    };
+    constexpr Benchmark Benchmarks[] {
+        { "reg-arithmetic", regArithmetic, regArithmeticResult },
+        { "reg-logical", logical, logicalResult },
+        { "reg-bit", bitOperations, bitOperationsResult },
+        { "cobr-compare-branch", compareAndBranch, compareAndBranchResult },
+        { "mem-mema-absolute", memoryAccess<Mode::MEMA_AbsoluteOffset>, memoryAccessResult },
+        { "mem-mema-register-offset", memoryAccess<Mode::MEMA_RegisterIndirectWithOffset>, memoryAccessResult },
+        { "mem-memb-register", memoryAccess<Mode::MEMB_RegisterIndirect>, memoryAccessResult },
+        { "mem-memb-register-index", memoryAccess<Mode::MEMB_RegisterIndirectWithIndex>, memoryAccessResult },
+        { "mem-memb-ip-displacement", memoryAccess<Mode::MEMB_IPWithDisplacement>, memoryAccessResult },
+        { "mem-memb-absolute", memoryAccess<Mode::MEMB_AbsoluteDisplacement>, memoryAccessResult },
+        { "mem-memb-register-displacement", memoryAccess<Mode::MEMB_RegisterIndirectWithDisplacement>, memoryAccessResult },
+        { "mem-memb-index-displacement", memoryAccess<Mode::MEMB_IndexWithDisplacement>, memoryAccessResult },
+        { "mem-memb-register-index-displacement", memoryAccess<Mode::MEMB_RegisterIndirectWithIndexAndDisplacement>, memoryAccessResult },
+        { "ctrl-call-ret", callReturn, callReturnResult },
+        { "reg-calls", systemCall, systemCallResult },
+        { "reg-synmov-iac", synchronousMove, synchronousMoveResult },
+    };
+    struct Result {
+        size_t instructions;
+        double seconds;
+        uint32_t spills;
+        uint32_t fills;
+        Ordinal value;
+    };
+    Result
+    runBenchmark(const Benchmark& benchmark, Ordinal iterations) noexcept {
+        auto core = std::make_unique<Core>();
+        Program program(CodeBase);
+        benchmark.build(program, iterations);
+        install(*core, program);
+        auto start = std::chrono::steady_clock::now();
+        auto completion = runUntilDone(*core, std::numeric_limits<size_t>::max());
+        auto end = std::chrono::steady_clock::now();
+        return { completion.instructions, std::chrono::duration<double>(end - start).count(), core->getFrameSpills(), core->getFrameFills(), result(*core) };
+    }
+}
+
+int main(int argc, char** argv) {
+    Ordinal iterations = DefaultIterations;
+    const char* filter = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-n") == 0 && (i + 1) < argc) {
+            iterations = static_cast<Ordinal>(std::strtoul(argv[++i], nullptr, 0));
+        } else {
+            filter = argv[i];
+        }
+    }
+    int failures = 0;
+    std::printf("%-40s %14s %10s %10s %10s %10s %8s\n", "benchmark", "instructions", "MIPS", "ns/inst", "spills", "fills", "result");
+    for (const auto& benchmark : Benchmarks) {
+        if (filter && !std::strstr(benchmark.name, filter)) {
+            continue;
+        }
+        auto result = runBenchmark(benchmark, iterations);
+        auto mips = (static_cast<double>(result.instructions) / result.seconds) / 1.0e6;
+        auto nsPerInstruction = (result.seconds * 1.0e9) / static_cast<double>(result.instructions);
+        auto expected = benchmark.expected(iterations);
+        auto correct = result.value == expected;
+        std::printf("%-40s %14zu %10.2f %10.2f %10u %10u %8s\n", benchmark.name, result.instructions, mips, nsPerInstruction, result.spills, result.fills, correct ? "ok" : "WRONG");
+        if (!correct) {
+            std::printf("    expected 0x%08x got 0x%08x\n", expected, result.value);
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
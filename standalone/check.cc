@@ -0,0 +1,461 @@
+// sim_ecore
+// Copyright (c) 2021-2022, Joshua Scoggins
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Behaviour checks for the host build. Each check is a small hand assembled guest program which accumulates what it
+// observes into g13, the runner compares that against the value the program has to produce. They exercise the pieces
+// which only show up as wrong answers rather than crashes: the data cache, store buffer and stack cache, DMA, the
+// atomics, lazy frame spill and restore, the frame store and the translated blocks. Build with the different
+// SIM_ECORE_ENABLE_* options (and a small SIM_ECORE_REGISTER_FRAMES) to cover each configuration.
+//
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include "GuestHarness.h"
+
+namespace {
+    using namespace GuestHarness;
+    using Mode = MEMFormatMode;
+    /**
+     * @brief Memory the checks are free to scribble on
+     */
+    constexpr Address Scratch = 0x6000;
+    constexpr Address InternalSRAM = 0xFFFE'0000;
+    constexpr Address DMABase = 0xFFFF'0A00;
+    /**
+     * @brief Anything which runs longer than this is considered hung
+     */
+    constexpr size_t InstructionLimit = 50'000'000;
+
+    /**
+     * @brief What installSystemTables leaves in the word at the given offset from DataBase
+     */
+    constexpr Ordinal
+    patternWord(Address offset) noexcept {
+        return offset * 0x0101'0101;
+    }
+    void
+    loadConstant(Program& p, Encoder::Operand destination, Ordinal value) noexcept {
+        p.emit(memb(Opcode::lda, destination, Mode::MEMB_AbsoluteDisplacement, r(0)), static_cast<Integer>(value));
+    }
+    void
+    access(Program& p, Opcode opcode, Encoder::Operand value, Address address) noexcept {
+        p.emit(memb(opcode, value, Mode::MEMB_AbsoluteDisplacement, r(0)), static_cast<Integer>(address));
+    }
+    void
+    accumulate(Program& p, Encoder::Operand value) noexcept {
+        p.emit(reg(Opcode::addo, value, g(13), g(13)));
+    }
+    /**
+     * @brief Load a word and add it into the result
+     */
+    void
+    accumulateWord(Program& p, Address address) noexcept {
+        access(p, Opcode::ld, r(4), address);
+        accumulate(p, r(4));
+    }
+
+    /**
+     * @brief The cases from tests/add_test.s: g2 = g0 op g1 is compared against what it should be, each case that
+     * matches sets its own bit in the result
+     */
+    struct ArithmeticCase {
+        Opcode operation;
+        Opcode compare;
+        Integer src1;
+        Integer src2;
+        Integer expected;
+    };
+    constexpr ArithmeticCase ArithmeticCases[] {
+        { Opcode::addo, Opcode::cmpo, 1, 2, 3 },
+        { Opcode::subo, Opcode::cmpo, 1, 2, 1 },
+        { Opcode::mulo, Opcode::cmpo, 3, 2, 6 },
+        { Opcode::addi, Opcode::cmpi, -4, -3, -7 },
+        { Opcode::subi, Opcode::cmpi, -4, -3, 1 },
+        { Opcode::muli, Opcode::cmpi, -4, -3, 12 },
+    };
+    void
+    arithmetic(Program& p) noexcept {
+        Ordinal bit = 0;
+        for (const auto& c : ArithmeticCases) {
+            loadConstant(p, g(1), c.src1);
+            loadConstant(p, g(0), c.src2);
+            loadConstant(p, r(4), c.expected);
+            p.emit(reg(c.operation, g(1), g(0), g(2)));
+            p.emit(reg(c.compare, g(2), r(4), r(0)));
+            p.emit(cobr(Opcode::teste, r(5), r(0), 0));
+            p.emit(reg(Opcode::shlo, lit(bit++), r(5), r(5)));
+            accumulate(p, r(5));
+        }
+        finish(p);
+    }
+    constexpr Ordinal
+    arithmeticResult() noexcept {
+        return (Ordinal(1) << std::size(ArithmeticCases)) - 1;
+    }
+
+    /**
+     * @brief Recurse well past the on chip frames keeping the depth both in a local and in a stack variable, both are
+     * added into the result on the way back out
+     */
+    constexpr Ordinal RecursionDepth = 200;
+    void
+    recursion(Program& p) noexcept {
+        loadConstant(p, g(5), RecursionDepth);
+        auto call = p.here();
+        p.emit(ctrl(Opcode::call, 0));
+        finish(p);
+        auto function = p.here();
+        p.patch(call, function);
+        // make room for one stack variable
+        p.emit(reg(Opcode::addo, lit(16), r(1), r(1)));
+        p.emit(reg(Opcode::mov, g(5), r(0), r(4)));
+        p.emit(mema(Opcode::st, g(5), g(15), 64));
+        auto leaf = p.here();
+        p.emit(cobr(Opcode::cmpobe, lit(0), g(5), 0));
+        p.emit(reg(Opcode::subo, lit(1), g(5), g(5)));
+        p.branch(Opcode::call, function);
+        p.emit(mema(Opcode::ld, r(6), g(15), 64));
+        accumulate(p, r(4));
+        accumulate(p, r(6));
+        p.patch(leaf, p.here());
+        p.emit(ctrl(Opcode::ret, 0));
+    }
+    constexpr Ordinal
+    recursionResult() noexcept {
+        return RecursionDepth * (RecursionDepth + 1);
+    }
+
+    /**
+     * @brief Levels further than this from the leaf can not still be on chip
+     */
+    constexpr Ordinal OnChipFrames = NUM_REGISTER_FRAMES;
+    constexpr Ordinal EvictedLevels = 8;
+    constexpr Ordinal FrameDepth = OnChipFrames + EvictedLevels;
+    /**
+     * @brief Enough passes for the leaf loop to be translated while a freshly evicted frame is still around
+     */
+    constexpr Ordinal FramePasses = 40;
+    constexpr Address FramePointerTable = Scratch;
+    /**
+     * @brief Level k of the recursion (counting down to one at the leaf) records its frame pointer in a table and keeps
+     * 17k in r4 and 17k + 1 in r5. The leaf walks the levels which have to be evicted by now, reading each one's r4 out of
+     * memory and overwriting its r5 with 17k + 100, then every level adds its r4 and r5 into the result as it returns.
+     */
+    void
+    evictedFrames(Program& p) noexcept {
+        loadConstant(p, g(8), FramePointerTable);
+        loadConstant(p, g(9), 100);
+        loadConstant(p, g(10), FrameDepth);
+        loadConstant(p, g(11), FramePasses);
+        auto pass = p.here();
+        p.emit(reg(Opcode::mov, g(10), r(0), g(5)));
+        auto call = p.here();
+        p.emit(ctrl(Opcode::call, 0));
+        p.emit(reg(Opcode::subo, lit(1), g(11), g(11)));
+        p.compareAndBranch(Opcode::cmpobne, lit(0), g(11), pass);
+        finish(p);
+        auto function = p.here();
+        p.patch(call, function);
+        p.emit(memb(Opcode::st, g(15), Mode::MEMB_RegisterIndirectWithIndex, g(8), g(5), 2));
+        p.emit(reg(Opcode::mulo, lit(17), g(5), r(4)));
+        p.emit(reg(Opcode::addo, lit(1), r(4), r(5)));
+        p.emit(reg(Opcode::subo, lit(1), g(5), g(5)));
+        auto recurse = p.here();
+        p.emit(cobr(Opcode::cmpobne, lit(0), g(5), 0));
+        loadConstant(p, g(6), OnChipFrames + 1);
+        auto walk = p.here();
+        p.emit(memb(Opcode::ld, r(8), Mode::MEMB_RegisterIndirectWithIndex, g(8), g(6), 2));
+        // r4 and r5 are the fifth and sixth words of the frame
+        p.emit(mema(Opcode::ld, r(9), r(8), 16));
+        accumulate(p, r(9));
+        p.emit(reg(Opcode::mulo, lit(17), g(6), r(10)));
+        p.emit(reg(Opcode::addo, g(9), r(10), r(10)));
+        p.emit(mema(Opcode::st, r(10), r(8), 20));
+        p.emit(reg(Opcode::addo, lit(1), g(6), g(6)));
+        p.compareAndBranch(Opcode::cmpobge, g(10), g(6), walk);
+        auto unwind = p.here();
+        p.branch(Opcode::b, 0);
+        p.patch(recurse, p.here());
+        p.branch(Opcode::call, function);
+        p.patch(unwind, p.here());
+        accumulate(p, r(4));
+        accumulate(p, r(5));
+        p.emit(reg(Opcode::addo, lit(1), g(5), g(5)));
+        p.emit(ctrl(Opcode::ret, 0));
+    }
+    constexpr Ordinal
+    evictedFramesResult() noexcept {
+        Ordinal perPass = 0;
+        for (Ordinal k = 1; k <= FrameDepth; ++k) {
+            auto evicted = k > OnChipFrames;
+            // r4 and r5 on the way out, plus the leaf reading r4 of the evicted levels
+            perPass += (17 * k) + (evicted ? (17 * k) + 100 : (17 * k) + 1);
+            perPass += evicted ? 17 * k : 0;
+        }
+        return perPass * FramePasses;
+    }
+
+    constexpr Ordinal PartialRestorePasses = 40;
+    /**
+     * @brief A procedure fills r4, r8, r12 and r15 and then makes two calls deep enough to evict it. Coming back from the
+     * first only reads its linkage quad back in, the rest have to survive the second eviction untouched before they are
+     * added into the result. Every level of the deep calls scribbles on the same registers.
+     */
+    void
+    partialRestore(Program& p) noexcept {
+        loadConstant(p, g(11), PartialRestorePasses);
+        // the call is the first instruction of the loop, it gets patched once the procedure is placed
+        auto pass = p.here();
+        p.emit(ctrl(Opcode::call, 0));
+        p.emit(reg(Opcode::subo, lit(1), g(11), g(11)));
+        p.compareAndBranch(Opcode::cmpobne, lit(0), g(11), pass);
+        finish(p);
+        auto deep = p.here();
+        p.emit(reg(Opcode::subo, lit(1), g(5), g(5)));
+        for (auto scribble : { r(4), r(8), r(12), r(15) }) {
+            p.emit(reg(Opcode::mov, g(5), r(0), scribble));
+        }
+        auto leaf = p.here();
+        p.emit(cobr(Opcode::cmpobe, lit(0), g(5), 0));
+        p.branch(Opcode::call, deep);
+        p.patch(leaf, p.here());
+        p.emit(ctrl(Opcode::ret, 0));
+        p.patch(pass, p.here());
+        p.emit(mema(Opcode::lda, r(4), 0x111));
+        p.emit(mema(Opcode::lda, r(8), 0x222));
+        p.emit(mema(Opcode::lda, r(12), 0x333));
+        p.emit(mema(Opcode::lda, r(15), 0x444));
+        for (int i = 0; i < 2; ++i) {
+            loadConstant(p, g(5), OnChipFrames + 2);
+            p.branch(Opcode::call, deep);
+        }
+        for (auto kept : { r(4), r(8), r(12), r(15) }) {
+            accumulate(p, kept);
+        }
+        p.emit(ctrl(Opcode::ret, 0));
+    }
+    constexpr Ordinal
+    partialRestoreResult() noexcept {
+        return (0x111 + 0x222 + 0x333 + 0x444) * PartialRestorePasses;
+    }
+
+    /**
+     * @brief Ram is the default 64MiB and addresses past it alias back to the start
+     */
+    constexpr Address RamEnd = HostBusBackend::DefaultMemorySize;
+    /**
+     * @brief Sequential stores running off the end of ram into its alias of address zero, read back through the other
+     * name of each word once they are out on the bus, then a store through an alias read back before anything drains it.
+     * The boot record the stores land on is put back afterwards.
+     */
+    void
+    ramAlias(Program& p) noexcept {
+        constexpr Ordinal Words[] { 0x1111'1111, 0x2222'2222, 0x3333'3333, 0x4444'4444 };
+        for (Address i = 0; i < 4; ++i) {
+            loadConstant(p, r(5), Words[i]);
+            access(p, Opcode::st, r(5), RamEnd - 8 + (i * 4));
+        }
+        p.emit(reg(Opcode::syncf, r(0), r(0), r(0)));
+        for (auto address : { (2 * RamEnd) - 8, RamEnd - 4, Address(0), Address(4) }) {
+            accumulateWord(p, address);
+        }
+        loadConstant(p, r(5), Words[0]);
+        access(p, Opcode::st, r(5), RamEnd + Scratch);
+        accumulateWord(p, Scratch);
+        loadConstant(p, r(5), SystemAddressTableBase);
+        access(p, Opcode::st, r(5), 0);
+        loadConstant(p, r(5), PRCBBase);
+        access(p, Opcode::st, r(5), 4);
+        finish(p);
+    }
+    constexpr Ordinal
+    ramAliasResult() noexcept {
+        return Ordinal(0x1111'1111) + 0x2222'2222 + 0x3333'3333 + 0x4444'4444 + 0x1111'1111;
+    }
+
+    void
+    dmaTransfer(Program& p, Address source, Address destination, Ordinal length, Ordinal mode) noexcept {
+        loadConstant(p, r(4), source);
+        access(p, Opcode::st, r(4), DMABase);
+        loadConstant(p, r(4), destination);
+        access(p, Opcode::st, r(4), DMABase + 4);
+        loadConstant(p, r(4), length);
+        access(p, Opcode::st, r(4), DMABase + 8);
+        loadConstant(p, r(4), mode);
+        access(p, Opcode::stob, r(4), DMABase + 12);
+        // writing the control byte starts the transfer
+        loadConstant(p, r(4), 1);
+        access(p, Opcode::stob, r(4), DMABase + 13);
+    }
+    constexpr Ordinal StoredWord = 0xCAFE'F00D;
+    /**
+     * @brief Copy (to an unaligned destination, from a source with a fresh store in it), an overlapping move, a fill of
+     * the internal SRAM and a copy back out of it
+     */
+    void
+    dma(Program& p) noexcept {
+        loadConstant(p, r(5), StoredWord);
+        access(p, Opcode::st, r(5), DataBase + 0x40);
+        dmaTransfer(p, DataBase, Scratch + 3, 100, 0);
+        dmaTransfer(p, DataBase, DataBase + 0x10, 64, 2);
+        dmaTransfer(p, 0xAB, InternalSRAM + 0x10, 40, 1);
+        dmaTransfer(p, InternalSRAM, Scratch + 0x100, 64, 0);
+        for (auto address : { Scratch + 0x43, Scratch + 0x63, DataBase + 0x14, DataBase + 0x4C, DataBase + 0x50,
+                              Scratch + 0x110, Scratch + 0x134, Scratch + 0x138 }) {
+            accumulateWord(p, address);
+        }
+        finish(p);
+    }
+    constexpr Ordinal
+    dmaResult() noexcept {
+        return StoredWord + patternWord(0x60) + patternWord(0x04) + patternWord(0x3C) + patternWord(0x50) +
+               0xABAB'ABAB + 0xABAB'ABAB;
+    }
+
+    /**
+     * @brief atadd and atmod on the same word, both old values and the final word go into the result
+     */
+    void
+    atomics(Program& p) noexcept {
+        loadConstant(p, r(5), DataBase + 0x08);
+        loadConstant(p, r(6), 5);
+        p.emit(reg(Opcode::atadd, r(5), r(6), r(7)));
+        loadConstant(p, r(8), 0xFFFF'0000);
+        loadConstant(p, r(9), 0x1234'5678);
+        p.emit(reg(Opcode::atmod, r(5), r(8), r(9)));
+        accumulate(p, r(7));
+        accumulate(p, r(9));
+        accumulateWord(p, DataBase + 0x08);
+        finish(p);
+    }
+    constexpr Ordinal
+    atomicsResult() noexcept {
+        constexpr Ordinal added = patternWord(0x08) + 5;
+        return patternWord(0x08) + added + ((0x1234'5678 & 0xFFFF'0000) | (added & 0x0000'FFFF));
+    }
+
+    /**
+     * @brief Quad and triple loads and stores, through the internal SRAM and to an unaligned address
+     */
+    void
+    multiword(Program& p) noexcept {
+        access(p, Opcode::ldq, r(8), DataBase + 0x20);
+        access(p, Opcode::stq, r(8), Scratch);
+        access(p, Opcode::ldt, r(12), DataBase + 0x48);
+        access(p, Opcode::stt, r(12), InternalSRAM + 0x100);
+        access(p, Opcode::ldt, g(4), InternalSRAM + 0x100);
+        access(p, Opcode::stt, g(4), Scratch + 0x13);
+        for (auto address : { Scratch, Scratch + 4, Scratch + 8, Scratch + 12, Scratch + 0x13, Scratch + 0x17, Scratch + 0x1B }) {
+            accumulateWord(p, address);
+        }
+        finish(p);
+    }
+    constexpr Ordinal
+    multiwordResult() noexcept {
+        return patternWord(0x20) + patternWord(0x24) + patternWord(0x28) + patternWord(0x2C) +
+               patternWord(0x48) + patternWord(0x4C) + patternWord(0x50);
+    }
+
+    constexpr Ordinal CodePatchPasses = 40;
+    constexpr Ordinal CountedLoop = 100;
+    /**
+     * @brief A hot loop stores an instruction over the body of a procedure which counts into the result and then calls
+     * it. The store puts back the instruction which is already there until the last pass, by then both loops are
+     * translated and the procedure has to be thrown away and rebuilt when the store changes it to add two instead.
+     */
+    void
+    selfModifyingCode(Program& p) noexcept {
+        auto overFunction = p.here();
+        p.branch(Opcode::b, 0);
+        auto function = p.here();
+        loadConstant(p, r(4), CountedLoop);
+        auto loop = p.here();
+        accumulate(p, lit(1));
+        p.emit(reg(Opcode::subo, lit(1), r(4), r(4)));
+        p.compareAndBranch(Opcode::cmpobne, lit(0), r(4), loop);
+        p.emit(ctrl(Opcode::ret, 0));
+        p.patch(overFunction, p.here());
+        loadConstant(p, g(7), reg(Opcode::addo, lit(1), g(13), g(13)));
+        loadConstant(p, g(8), loop);
+        loadConstant(p, r(5), CodePatchPasses);
+        auto pass = p.here();
+        p.emit(mema(Opcode::st, g(7), g(8), 0));
+        p.branch(Opcode::call, function);
+        p.emit(reg(Opcode::subo, lit(1), r(5), r(5)));
+        auto keep = p.here();
+        p.emit(cobr(Opcode::cmpobne, lit(1), r(5), 0));
+        loadConstant(p, g(7), reg(Opcode::addo, lit(2), g(13), g(13)));
+        p.patch(keep, p.here());
+        p.compareAndBranch(Opcode::cmpobne, lit(0), r(5), pass);
+        finish(p);
+    }
+    constexpr Ordinal
+    selfModifyingCodeResult() noexcept {
+        return ((CodePatchPasses - 1) * CountedLoop) + (2 * CountedLoop);
+    }
+
+    struct Check {
+        const char* name;
+        void (*build)(Program&);
+        Ordinal expected;
+    };
+    constexpr Check Checks[] {
+        { "arithmetic", arithmetic, arithmeticResult() },
+        { "recursion", recursion, recursionResult() },
+        { "evicted-frames", evictedFrames, evictedFramesResult() },
+        { "partial-restore", partialRestore, partialRestoreResult() },
+        { "ram-alias", ramAlias, ramAliasResult() },
+        { "dma", dma, dmaResult() },
+        { "atomics", atomics, atomicsResult() },
+        { "multiword", multiword, multiwordResult() },
+        { "self-modifying-code", selfModifyingCode, selfModifyingCodeResult() },
+    };
+}
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+    int failures = 0;
+    for (const auto& check : Checks) {
+        if (filter && !std::strstr(check.name, filter)) {
+            continue;
+        }
+        auto core = std::make_unique<Core>();
+        Program program(CodeBase);
+        program.emit(mema(Opcode::lda, g(13), 0));
+        check.build(program);
+        install(*core, program);
+        auto completion = runUntilDone(*core, InstructionLimit);
+        if (!completion.finished) {
+            std::printf("%-24s did not finish after %zu instructions\n", check.name, completion.instructions);
+            ++failures;
+        } else if (auto value = result(*core); value != check.expected) {
+            std::printf("%-24s WRONG: expected 0x%08x got 0x%08x\n", check.name, check.expected, value);
+            ++failures;
+        } else {
+            std::printf("%-24s ok\n", check.name);
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
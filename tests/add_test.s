@@ -32,13 +32,13 @@ subi_test:
 	ldconst -3, g0
 	ldconst -4, g1
 	subi g1, g0, g2
-	cmpi g3, 1
+	cmpi g2, 1
 	faultne
 
 muli_test:
 	ldconst -3, g0
 	ldconst -4, g1
 	muli g1, g0, g2
-	cmpi g3, 12
+	cmpi g2, 12
 	faultne
 
@@ -0,0 +1,193 @@
+# Reference listing of the microbenchmarks standalone/bench.cc runs, nothing assembles this file. There is no i960
+# toolchain in the host build so bench.cc encodes the programs itself (standalone/InstructionEncoder.h) and is the one
+# source of truth, this is only here to read them as assembly and is updated to follow it. Every benchmark is installed
+# at 0x1000, uses g0 as the loop counter and repeats its body eight times per iteration. It accumulates a result in g13
+# which the runner checks, then finishes by storing g13 to 0x704 and a one to 0x700 (followed by a syncf so they get
+# past the data cache) and spins, counting trips around the spin loop at 0x708 so the runner can leave them out of the
+# count.
+.set ITERATIONS, 200000
+.set DATA, 0x4000
+.set DONE, 0x700
+.set RESULT, 0x704
+.set SPINS, 0x708
+
+.macro load_bases
+	lda DATA, g1
+	lda 3, g2
+	lda 0x12345678, g3
+	lda 0x35, g4
+.endm
+
+.macro begin_loop
+	lda 0, g13
+	lda ITERATIONS, g0
+.endm
+
+.macro close_loop top
+	subo 1, g0, g0
+	cmpobne 0, g0, \top
+.endm
+
+.macro finish
+	st g13, RESULT
+	lda 0, g14
+	lda 1, r3
+	st r3, DONE
+	syncf
+	b 0f
+0:	addo 1, g14, g14
+	st g14, SPINS
+	syncf
+	b 0b
+.endm
+
+.macro end_loop top
+	close_loop \top
+	finish
+.endm
+
+.text
+reg_arithmetic:
+	load_bases
+	begin_loop
+1:	.rept 8
+	addo g4, g3, r4
+	subo 7, r4, r5
+	mulo g4, r5, r6
+	addi 3, r6, r7
+	divo g4, r7, r8
+	remo 9, r7, r9
+	shlo 3, r9, r10
+	shro 1, r10, r11
+	.endr
+	addo r8, g13, g13
+	addo r11, g13, g13
+	end_loop 1b
+
+reg_logical:
+	load_bases
+	begin_loop
+1:	.rept 8
+	and g4, g3, r4
+	or 6, r4, r5
+	xor g3, r5, r6
+	not r6, r7
+	andnot r7, g3, r8
+	nor r8, g4, r9
+	xnor r9, r6, r10
+	mov r10, r11
+	.endr
+	addo r8, g13, g13
+	addo r11, g13, g13
+	end_loop 1b
+
+reg_bit:
+	load_bases
+	begin_loop
+1:	.rept 8
+	setbit 5, g3, r4
+	clrbit 4, r4, r5
+	notbit 31, r5, r6
+	alterbit 2, r6, r7
+	chkbit 3, r7
+	scanbit r7, r8
+	spanbit r7, r9
+	extract 4, 8, r9
+	.endr
+	addo r6, g13, g13
+	addo r8, g13, g13
+	addo r9, g13, g13
+	end_loop 1b
+
+cobr_compare_branch:
+	load_bases
+	begin_loop
+1:	.rept 8		# each branch skips an increment of the result
+	cmpobe 3, g2, 2f	# taken
+	addo 1, g13, g13
+2:	cmpobne 3, g2, 2f	# not taken
+	addo 1, g13, g13
+2:	cmpibl 2, g2, 2f	# taken
+	addo 1, g13, g13
+2:	cmpibg 2, g2, 2f	# not taken
+	addo 1, g13, g13
+2:	bbs 0, g2, 2f		# taken
+	addo 1, g13, g13
+2:	bbc 0, g2, 2f		# not taken
+	addo 1, g13, g13
+2:
+	.endr
+	end_loop 1b
+
+# one benchmark per addressing mode, each body is a load and a store using that mode to the same word so each load
+# after the first returns what was stored
+mem_mema_absolute:			# ld 0x800, r4 / st r5, 0x800
+mem_mema_register_offset:		# ld 0x10(g1), r4
+mem_memb_register:			# ld (g1), r4
+mem_memb_register_index:		# ld (g1)[g2*4], r4
+mem_memb_ip_displacement:		# ld DATA-(.+8)(ip), r4
+mem_memb_absolute:			# ld DATA+0x20, r4
+mem_memb_register_displacement:	# ld 0x24(g1), r4
+mem_memb_index_displacement:		# ld DATA[g2*4], r4
+mem_memb_register_index_displacement:	# ld 0x40(g1)[g2*4], r4
+	load_bases
+	lda 0x600DF00D, r5
+	begin_loop
+1:	.rept 8
+	ld (g1), r4
+	st r5, (g1)
+	.endr
+	addo r4, g13, g13
+	end_loop 1b
+
+# recurse eight deep, past the four on chip register frames of the real chip; each level keeps its depth in r4 and
+# adds it to the result on the way out
+ctrl_call_ret:
+	begin_loop
+1:	lda 8, g5
+	call recurse
+	end_loop 1b
+recurse:
+	subo 1, g5, g5
+	mov g5, r4
+	cmpobe 0, g5, 2f
+	call recurse
+2:	addo r4, g13, g13
+	addo 1, g5, g5
+	ret
+
+# system procedure table entry zero is a local procedure which increments the result
+reg_calls:
+	begin_loop
+1:	.rept 8
+	calls 0
+	.endr
+	end_loop 1b
+
+# DATA+0x100 holds a store system base IAC message (type 0x80) whose field 3 points at DATA+0x200
+reg_synmov_iac:
+	load_bases
+	lda DATA+0x100, g5
+	lda 0xFF000010, g6
+	lda DATA+0x80, g7
+	lda 0x80000000, r4
+	st r4, DATA+0x100
+	lda DATA+0x200, r4
+	st r4, DATA+0x104
+	begin_loop
+1:	.rept 8
+	synmov g7, g1
+	synmovq g6, g5
+	.endr
+	close_loop 1b
+	ld DATA+0x80, r4	# the word synmov copied
+	addo r4, g13, g13
+	ld DATA+0x200, r4	# the two bases the IAC stored
+	addo r4, g13, g13
+	ld DATA+0x204, r4
+	addo r4, g13, g13
+	finish
+
+procedure_zero:
+	addo 1, g13, g13
+	ret